@@ -0,0 +1,112 @@
+#include "intrhash/hashers.h"
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <string_view>
+#include <vector>
+
+// Prints one CSV line per (hasher, key length):
+//   hasher,key_len,ns_per_hash,gb_per_sec
+// Keys are read at shifting offsets of one buffer, and every hash feeds the
+// offset of the next key, so the numbers are latencies rather than throughput
+// of independent hashes.
+
+namespace {
+    using clock_type = std::chrono::steady_clock;
+
+    volatile uint64_t sink;
+
+    constexpr size_t buffer_size = 1 << 16;
+
+    template <class F>
+    void run(const char* name, size_t len, const std::vector<unsigned char>& buffer, F&& hash) {
+        const size_t nhashes = std::max<size_t>((size_t(1) << 28) / (len + 16), 1 << 16);
+        uint64_t result = 0;
+        const auto start = clock_type::now();
+
+        for (size_t i = 0; i != nhashes; ++i) {
+            result += hash(buffer.data() + ((i * 64 + (result & 7)) & (buffer_size - 1)), len);
+        }
+
+        const double ns = std::chrono::duration<double, std::nano>(clock_type::now() - start).count();
+        sink = result;
+
+        std::printf("%s,%zu,%.2f,%.2f\n", name, len, ns / nhashes, len * nhashes / ns);
+    }
+
+    template <class T>
+    void run_int(const char* name, const std::vector<unsigned char>& buffer, T (*hash)(uint64_t)) {
+        run(name, sizeof(uint64_t), buffer, [hash](const unsigned char* ptr, size_t) {
+            return static_cast<uint64_t>(hash(intrhash_hash_priv::read64(ptr)));
+        });
+    }
+
+    uint64_t std_int_hash(uint64_t key) {
+        return std::hash<uint64_t>()(key);
+    }
+
+    uint64_t int_ops_hash(uint64_t key) {
+        return intrhash_int_ops::hash(key);
+    }
+}
+
+int main(int argc, char** argv) {
+    size_t max_len = 4096;
+
+    for (int i = 1; i < argc; ++i) {
+        if (!std::strncmp(argv[i], "--max-len=", 10)) {
+            max_len = std::strtoull(argv[i] + 10, nullptr, 10);
+        } else {
+            std::fprintf(stderr, "usage: %s [--max-len=N]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    std::vector<unsigned char> buffer(buffer_size + max_len);
+
+    for (size_t i = 0; i != buffer.size(); ++i) {
+        buffer[i] = static_cast<unsigned char>(i * 0x9e3779b1u >> 24);
+    }
+
+    std::printf("hasher,key_len,ns_per_hash,gb_per_sec\n");
+
+    for (size_t len = 4; len <= max_len; len *= 2) {
+        for (const size_t n : {len, len * 3 / 2}) {
+            if (n > max_len || (n != len && n < 16)) {
+                continue;
+            }
+
+            run("std_hash", n, buffer, [](const unsigned char* ptr, size_t len) {
+                return static_cast<uint64_t>(std::hash<std::string_view>()(std::string_view(reinterpret_cast<const char*>(ptr), len)));
+            });
+
+            run("intrhash_string_ops", n, buffer, [](const unsigned char* ptr, size_t len) {
+                return static_cast<uint64_t>(intrhash_string_ops::hash(std::string_view(reinterpret_cast<const char*>(ptr), len)));
+            });
+
+            // the long key kernels on their own, below short_max too
+            if (n >= intrhash_hash_priv::stripe_size) {
+                run("long_scalar", n, buffer, [](const unsigned char* ptr, size_t len) {
+                    return intrhash_hash_priv::hash_long<intrhash_hash_priv::scalar_kernel>(ptr, len);
+                });
+
+#if defined(INTRHASH_HASH_AVX2)
+                if (__builtin_cpu_supports("avx2")) {
+                    run("long_avx2", n, buffer, [](const unsigned char* ptr, size_t len) {
+                        return intrhash_hash_priv::hash_long<intrhash_hash_priv::avx2_kernel>(ptr, len);
+                    });
+                }
+#endif
+            }
+        }
+    }
+
+    run_int("std_hash_u64", buffer, std_int_hash);
+    run_int("intrhash_int_ops", buffer, int_ops_hash);
+
+    return 0;
+}
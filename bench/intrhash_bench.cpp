@@ -0,0 +1,483 @@
+#include "intrhash/hashmap.h"
+#include "intrhash/hashset.h"
+#include "intrhash/flatmap.h"
+#include "intrhash/flatset.h"
+#include "intrhash/slaballc.h"
+#include "intrhash/hashers.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#define INTRHASH_BENCH_FORK 1
+#endif
+
+// Prints one CSV line per (container, key type, size, workload):
+//   container,key,workload,size,ops,ns_per_op,ops_per_sec,peak_rss_kb
+// Every (container, key type, size) runs in its own process where fork() is
+// available, so peak_rss_kb belongs to that configuration alone.
+
+struct pod16_t {
+    uint64_t hi;
+    uint64_t lo;
+
+    bool operator==(const pod16_t& right) const noexcept {
+        return hi == right.hi && lo == right.lo;
+    }
+};
+
+namespace std {
+    template <>
+    struct hash<pod16_t> {
+        size_t operator()(const pod16_t& key) const noexcept {
+            return static_cast<size_t>((key.hi ^ (key.lo >> 29)) * 0xbf58476d1ce4e5b9ull ^ key.lo);
+        }
+    };
+}
+
+namespace {
+    uint64_t mix(uint64_t x) noexcept {
+        x += 0x9e3779b97f4a7c15ull;
+        x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+        x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+        return x ^ (x >> 31);
+    }
+
+    // distinct indices give distinct keys
+    template <class K>
+    K make_key(uint64_t i);
+
+    template <>
+    int make_key<int>(uint64_t i) {
+        return static_cast<int>(static_cast<uint32_t>(i * 0x9e3779b1u));
+    }
+
+    template <>
+    pod16_t make_key<pod16_t>(uint64_t i) {
+        return {mix(i), i};
+    }
+
+    template <>
+    std::string make_key<std::string>(uint64_t i) {
+        char buf[32];
+        std::snprintf(buf, sizeof(buf), "%016llx%08llx", static_cast<unsigned long long>(mix(i)), static_cast<unsigned long long>(i));
+        return buf;
+    }
+
+    template <class K>
+    const char* key_name();
+
+    template <>
+    const char* key_name<int>() {
+        return "int";
+    }
+
+    template <>
+    const char* key_name<pod16_t>() {
+        return "pod16";
+    }
+
+    template <>
+    const char* key_name<std::string>() {
+        return "string";
+    }
+
+    template <class K>
+    struct own_node_t
+        : public intrhash_item_t<own_node_t<K>>
+    {
+        own_node_t(const K& _key, uint64_t _value)
+            : key(_key)
+            , value(_value)
+        {}
+
+        const K key;
+        uint64_t value;
+    };
+
+    struct own_ops
+        : public generic_intrhash_ops
+    {
+        template <class K>
+        static const K& extract_key(const own_node_t<K>& node) noexcept {
+            return node.key;
+        }
+    };
+
+    // the node based tables; the flat ones have no extract()
+    template <class C, class = void>
+    struct has_extract: std::false_type {};
+
+    template <class C>
+    struct has_extract<C, decltype(void(std::declval<C&>().extract(std::declval<typename C::const_iterator>())))>: std::true_type {};
+
+    template <class M>
+    struct map_adapter {
+        using key_type = typename std::remove_const<typename M::value_type::first_type>::type;
+
+        void insert(const key_type& key, uint64_t value) {
+            map.insert({key, value});
+        }
+
+        bool has(const key_type& key) const {
+            return map.find(key) != map.end();
+        }
+
+        void erase(const key_type& key) {
+            map.erase(key);
+        }
+
+        // takes the entry out through a const_iterator and puts it back
+        void relink(const key_type& key) {
+            map.insert(map.extract(static_cast<const M&>(map).find(key)));
+        }
+
+        uint64_t sum() const {
+            uint64_t result = 0;
+
+            for (const auto& value : map) {
+                result += value.second;
+            }
+
+            return result;
+        }
+
+        void grow() {
+            map.rehash(map.bucket_count() * 2);
+        }
+
+        void clear() {
+            map.clear();
+        }
+
+        size_t size() const {
+            return map.size();
+        }
+
+        static constexpr bool copyable = true;
+        static constexpr bool relinkable = has_extract<M>::value;
+
+        M map;
+    };
+
+    template <class S>
+    struct set_adapter {
+        using key_type = typename S::value_type;
+
+        void insert(const key_type& key, uint64_t) {
+            set.insert(key);
+        }
+
+        bool has(const key_type& key) const {
+            return set.find(key) != set.end();
+        }
+
+        void erase(const key_type& key) {
+            set.erase(key);
+        }
+
+        void relink(const key_type& key) {
+            set.insert(set.extract(static_cast<const S&>(set).find(key)));
+        }
+
+        uint64_t sum() const {
+            uint64_t result = 0;
+
+            for (const auto& value : set) {
+                result += sizeof(value);
+            }
+
+            return result;
+        }
+
+        void grow() {
+            set.rehash(set.bucket_count() * 2);
+        }
+
+        void clear() {
+            set.clear();
+        }
+
+        size_t size() const {
+            return set.size();
+        }
+
+        static constexpr bool copyable = true;
+        static constexpr bool relinkable = has_extract<S>::value;
+
+        S set;
+    };
+
+    template <class K>
+    struct own_adapter {
+        using key_type = K;
+        using node_type = own_node_t<K>;
+
+        void insert(const key_type& key, uint64_t value) {
+            table.find_or_push(key, [&key, value](){ return new node_type(key, value); });
+        }
+
+        bool has(const key_type& key) const {
+            return table.has(key);
+        }
+
+        void erase(const key_type& key) {
+            table.erase(key);
+        }
+
+        uint64_t sum() const {
+            uint64_t result = 0;
+
+            for (const auto& node : table) {
+                result += node.value;
+            }
+
+            return result;
+        }
+
+        void grow() {
+            table.rehash(table.bucket_count() * 2);
+        }
+
+        void clear() {
+            table.clear();
+        }
+
+        size_t size() const {
+            return table.size();
+        }
+
+        static constexpr bool copyable = false;
+        static constexpr bool relinkable = false;
+
+        ownintrhash_t<node_type, own_ops> table;
+    };
+
+    long peak_rss_kb() {
+#if defined(INTRHASH_BENCH_FORK)
+        rusage usage;
+        getrusage(RUSAGE_SELF, &usage);
+#if defined(__APPLE__)
+        return usage.ru_maxrss / 1024;
+#else
+        return usage.ru_maxrss;
+#endif
+#else
+        return 0;
+#endif
+    }
+
+    using clock_type = std::chrono::steady_clock;
+
+    volatile uint64_t sink;
+
+    void report(const char* container, const char* key, const char* workload, size_t size, size_t ops, clock_type::duration elapsed) {
+        const double ns = std::chrono::duration<double, std::nano>(elapsed).count();
+
+        std::printf("%s,%s,%s,%zu,%zu,%.2f,%.0f,%ld\n", container, key, workload, size, ops, ns / ops, ops / ns * 1e9, peak_rss_kb());
+    }
+
+    template <class C>
+    void copy_workload(const char* name, const char* key, const C& container, std::true_type) {
+        const auto start = clock_type::now();
+        const C copy(container);
+        report(name, key, "copy", container.size(), container.size(), clock_type::now() - start);
+        sink = copy.size();
+    }
+
+    template <class C>
+    void copy_workload(const char*, const char*, const C&, std::false_type) {
+    }
+
+    template <class C, class K>
+    void relink_workload(const char* name, const char* key, C& container, const std::vector<K>& keys, const std::vector<uint32_t>& order, std::true_type) {
+        const auto start = clock_type::now();
+
+        for (size_t i = 0; i != keys.size(); ++i) {
+            container.relink(keys[order[i]]);
+        }
+
+        report(name, key, "relink", keys.size(), keys.size(), clock_type::now() - start);
+    }
+
+    template <class C, class K>
+    void relink_workload(const char*, const char*, C&, const std::vector<K>&, const std::vector<uint32_t>&, std::false_type) {
+    }
+
+    template <class C>
+    void run(const char* name, size_t n) {
+        using key_type = typename C::key_type;
+
+        const char* const key = key_name<key_type>();
+        const size_t nlookups = std::max<size_t>(n, 1 << 20);
+
+        std::vector<key_type> keys;
+        std::vector<key_type> misses;
+        std::vector<uint32_t> order(n);
+
+        keys.reserve(n);
+        misses.reserve(n);
+
+        for (size_t i = 0; i != n; ++i) {
+            keys.push_back(make_key<key_type>(i));
+            misses.push_back(make_key<key_type>(i + n));
+            order[i] = static_cast<uint32_t>(i);
+        }
+
+        std::shuffle(order.begin(), order.end(), std::mt19937_64(n));
+
+        C container;
+        uint64_t found = 0;
+
+        auto start = clock_type::now();
+
+        for (size_t i = 0; i != n; ++i) {
+            container.insert(keys[i], i);
+        }
+
+        report(name, key, "insert", n, n, clock_type::now() - start);
+
+        start = clock_type::now();
+
+        for (size_t i = 0; i != nlookups; ++i) {
+            found += container.has(keys[order[i % n]]);
+        }
+
+        report(name, key, "hit", n, nlookups, clock_type::now() - start);
+
+        start = clock_type::now();
+
+        for (size_t i = 0; i != nlookups; ++i) {
+            found += container.has(misses[order[i % n]]);
+        }
+
+        report(name, key, "miss", n, nlookups, clock_type::now() - start);
+
+        start = clock_type::now();
+        found += container.sum();
+        report(name, key, "iterate", n, n, clock_type::now() - start);
+
+        copy_workload(name, key, container, std::integral_constant<bool, C::copyable>());
+        relink_workload(name, key, container, keys, order, std::integral_constant<bool, C::relinkable>());
+
+        start = clock_type::now();
+        container.grow();
+        report(name, key, "resize", n, n, clock_type::now() - start);
+
+        start = clock_type::now();
+
+        for (size_t i = 0; i != n; ++i) {
+            container.erase(keys[order[i]]);
+        }
+
+        report(name, key, "erase", n, n, clock_type::now() - start);
+
+        for (size_t i = 0; i != n; ++i) {
+            container.insert(keys[i], i);
+        }
+
+        start = clock_type::now();
+        container.clear();
+        report(name, key, "clear", n, n, clock_type::now() - start);
+
+        sink = found + container.size();
+    }
+
+    struct options_t {
+        size_t min_size = 1000;
+        size_t max_size = 1000000;
+        const char* filter = nullptr;
+    };
+
+    template <class C>
+    void spawn(const options_t& options, const char* name, size_t n) {
+        char label[128];
+        std::snprintf(label, sizeof(label), "%s,%s", name, key_name<typename C::key_type>());
+
+        if (options.filter && !std::strstr(label, options.filter)) {
+            return;
+        }
+
+#if defined(INTRHASH_BENCH_FORK)
+        std::fflush(stdout);
+
+        if (const pid_t pid = fork()) {
+            if (pid > 0) {
+                int status = 0;
+                waitpid(pid, &status, 0);
+                return;
+            }
+        } else {
+            run<C>(name, n);
+            std::fflush(stdout);
+            _exit(0);
+        }
+#endif
+
+        run<C>(name, n);
+    }
+
+    // the flat tables only take keys that move without throwing
+    template <class K>
+    void bench_flat(const options_t& options, size_t n, std::true_type) {
+        spawn<map_adapter<intrhash_flat_map_t<K, uint64_t>>>(options, "intrhash_flat_map", n);
+        spawn<set_adapter<intrhash_flat_set_t<K>>>(options, "intrhash_flat_set", n);
+    }
+
+    template <class K>
+    void bench_flat(const options_t&, size_t, std::false_type) {
+    }
+
+    template <class K>
+    void bench_key(const options_t& options, size_t n) {
+        spawn<map_adapter<intrhash_map_t<K, uint64_t>>>(options, "intrhash_map", n);
+        spawn<map_adapter<intrhash_map_t<K, uint64_t, generic_intrhash_ops, intrhash_slab_allocator<uint64_t>>>>(options, "intrhash_map_slab", n);
+        spawn<map_adapter<intrhash_map_t<K, uint64_t, intrhash_fast_ops>>>(options, "intrhash_map_fast", n);
+        spawn<map_adapter<intrhash_map_t<K, uint64_t, intrhash_fast_ops, std::allocator<uint64_t>, fingerprint_intrhash_policy>>>(options, "intrhash_map_fingerprint", n);
+        spawn<map_adapter<intrhash_map_t<K, uint64_t, intrhash_fast_ops, std::allocator<uint64_t>, bloom_intrhash_policy>>>(options, "intrhash_map_bloom", n);
+        spawn<map_adapter<std::unordered_map<K, uint64_t>>>(options, "std_unordered_map", n);
+        spawn<set_adapter<intrhash_set_t<K>>>(options, "intrhash_set", n);
+        spawn<set_adapter<std::unordered_set<K>>>(options, "std_unordered_set", n);
+        spawn<own_adapter<K>>(options, "ownintrhash", n);
+        bench_flat<K>(options, n, std::is_nothrow_move_constructible<std::pair<const K, uint64_t>>());
+    }
+}
+
+int main(int argc, char** argv) {
+    options_t options;
+
+    for (int i = 1; i < argc; ++i) {
+        if (!std::strncmp(argv[i], "--min-size=", 11)) {
+            options.min_size = std::strtoull(argv[i] + 11, nullptr, 10);
+        } else if (!std::strncmp(argv[i], "--max-size=", 11)) {
+            options.max_size = std::strtoull(argv[i] + 11, nullptr, 10);
+        } else if (!std::strncmp(argv[i], "--filter=", 9)) {
+            options.filter = argv[i] + 9;
+        } else {
+            std::fprintf(stderr, "usage: %s [--min-size=N] [--max-size=N] [--filter=container,key]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    std::printf("container,key,workload,size,ops,ns_per_op,ops_per_sec,peak_rss_kb\n");
+
+    for (size_t n = std::max<size_t>(options.min_size, 1); n <= options.max_size; n *= 10) {
+        bench_key<int>(options, n);
+        bench_key<pod16_t>(options, n);
+        bench_key<std::string>(options, n);
+    }
+
+    return 0;
+}
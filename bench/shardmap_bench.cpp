@@ -0,0 +1,124 @@
+#include "intrhash/shardmap.h"
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+
+namespace {
+    const uint64_t nkeys = 1 << 20;
+
+    class mutex_map_t {
+    public:
+        bool has(uint64_t key) {
+            std::lock_guard<std::mutex> guard(lock_);
+            return map_.has(key);
+        }
+
+        void insert(uint64_t key) {
+            std::lock_guard<std::mutex> guard(lock_);
+            map_.insert({key, key});
+        }
+
+        void erase(uint64_t key) {
+            std::lock_guard<std::mutex> guard(lock_);
+            map_.erase(key);
+        }
+
+    private:
+        std::mutex lock_;
+        intrhash_map_t<uint64_t, uint64_t> map_;
+    };
+
+    template <class M>
+    class sharded_map_t {
+    public:
+        bool has(uint64_t key) {
+            return map_.has(key);
+        }
+
+        void insert(uint64_t key) {
+            map_.insert({key, key});
+        }
+
+        void erase(uint64_t key) {
+            map_.erase(key);
+        }
+
+    private:
+        M map_;
+    };
+
+    // 90% lookups, 5% inserts, 5% erases over a fixed key space
+    template <class M>
+    double run(M& map, unsigned nthreads, size_t nops) {
+        std::vector<std::thread> threads;
+        const auto start = std::chrono::steady_clock::now();
+
+        for (unsigned t = 0; t != nthreads; ++t) {
+            threads.emplace_back([&map, t, nops](){
+                std::mt19937_64 rng(t + 1);
+                size_t found = 0;
+
+                for (size_t i = 0; i != nops; ++i) {
+                    const uint64_t r = rng();
+                    const uint64_t key = r % nkeys;
+
+                    switch ((r >> 32) % 20) {
+                        case 0:
+                            map.insert(key);
+                            break;
+                        case 1:
+                            map.erase(key);
+                            break;
+                        default:
+                            found += map.has(key);
+                    }
+                }
+
+                if (found == size_t(-1)) {
+                    std::abort();
+                }
+            });
+        }
+
+        for (auto& thread : threads) {
+            thread.join();
+        }
+
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    template <class M>
+    void bench(const char* name, unsigned nthreads, size_t nops) {
+        M map;
+
+        for (uint64_t key = 0; key < nkeys; key += 2) {
+            map.insert(key);
+        }
+
+        const double seconds = run(map, nthreads, nops);
+        const double total = static_cast<double>(nops) * nthreads;
+
+        std::printf("%s,%u,%.0f,%.4f,%.0f\n", name, nthreads, total, seconds, total / seconds);
+    }
+}
+
+int main(int argc, char** argv) {
+    const size_t nops = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 1000000;
+    const unsigned maxthreads = std::max(1u, std::thread::hardware_concurrency());
+
+    std::printf("impl,threads,ops,seconds,ops_per_sec\n");
+
+    for (unsigned nthreads = 1; nthreads <= maxthreads; nthreads *= 2) {
+        bench<mutex_map_t>("mutex", nthreads, nops);
+        bench<sharded_map_t<sharded_intrhash_map_t<uint64_t, uint64_t>>>("sharded_rw", nthreads, nops);
+        bench<sharded_map_t<sharded_intrhash_map_t<uint64_t, uint64_t, generic_intrhash_ops, std::allocator<uint64_t>, generic_intrhash_policy, intrhash_util::spin_lock>>>("sharded_spin", nthreads, nops);
+    }
+
+    return 0;
+}
@@ -0,0 +1,123 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+// Epoch based reclamation shared by every lock-free reader in the process.
+// A reader publishes the epoch it entered at; memory retired at epoch e may be
+// freed once every active reader has entered at a later epoch.
+class intrhash_epoch_t {
+private:
+    static constexpr uint64_t idle_ = ~uint64_t(0);
+
+    struct alignas(64) record_t {
+        std::atomic<uint64_t> epoch{idle_};
+        std::atomic<bool> used{true};
+        size_t nesting = 0;
+        record_t* next = nullptr;
+    };
+
+    struct holder_t {
+        record_t* const record = instance().acquire_();
+
+        ~holder_t() noexcept {
+            record->used.store(false, std::memory_order_release);
+        }
+    };
+
+    static record_t* local_() {
+        thread_local holder_t holder;
+        return holder.record;
+    }
+
+public:
+    static intrhash_epoch_t& instance() {
+        static intrhash_epoch_t epoch;
+        return epoch;
+    }
+
+    class guard_t {
+    public:
+        guard_t()
+            : record_(local_())
+        {
+            if (!record_->nesting++) {
+                record_->epoch.store(instance().epoch_.load(std::memory_order_relaxed), std::memory_order_relaxed);
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+            }
+        }
+
+        ~guard_t() noexcept {
+            if (!--record_->nesting) {
+                record_->epoch.store(idle_, std::memory_order_release);
+            }
+        }
+
+    private:
+        guard_t(const guard_t&) = delete;
+        guard_t& operator=(const guard_t&) = delete;
+
+    private:
+        record_t* const record_;
+    };
+
+public:
+    // call after unlinking; the result is the epoch to retire the memory at
+    uint64_t retire() noexcept {
+        return epoch_.fetch_add(1, std::memory_order_seq_cst);
+    }
+
+    uint64_t min_active() const noexcept {
+        uint64_t result = idle_;
+
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+        for (const record_t* record = records_.load(std::memory_order_acquire); record; record = record->next) {
+            const uint64_t epoch = record->epoch.load(std::memory_order_seq_cst);
+            result = epoch < result ? epoch : result;
+        }
+
+        return result;
+    }
+
+    bool safe(uint64_t retired) const noexcept {
+        return retired < min_active();
+    }
+
+private:
+    record_t* acquire_() {
+        for (record_t* record = records_.load(std::memory_order_acquire); record; record = record->next) {
+            bool used = false;
+
+            if (!record->used.load(std::memory_order_relaxed) && record->used.compare_exchange_strong(used, true, std::memory_order_acquire)) {
+                return record;
+            }
+        }
+
+        record_t* const record = new record_t;
+        record->next = records_.load(std::memory_order_relaxed);
+
+        while (!records_.compare_exchange_weak(record->next, record, std::memory_order_release, std::memory_order_relaxed)) {
+        }
+
+        return record;
+    }
+
+private:
+    intrhash_epoch_t() = default;
+
+    ~intrhash_epoch_t() noexcept {
+        for (record_t* record = records_.load(std::memory_order_relaxed); record;) {
+            record_t* const next = record->next;
+            delete record;
+            record = next;
+        }
+    }
+
+    intrhash_epoch_t(const intrhash_epoch_t&) = delete;
+    intrhash_epoch_t& operator=(const intrhash_epoch_t&) = delete;
+
+private:
+    std::atomic<uint64_t> epoch_{1};
+    std::atomic<record_t*> records_{nullptr};
+};
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <functional>
+#include <thread>
+#include <vector>
+
+namespace intrhash_util {
+    // runs task(0) .. task(concurrency() - 1) in parallel and waits for all of
+    // them; a task whose thread cannot be started runs on the calling thread
+    class thread_executor {
+    public:
+        explicit thread_executor(size_t n = std::thread::hardware_concurrency())
+            : concurrency_(n ? n : 1)
+        {}
+
+        size_t concurrency() const noexcept {
+            return concurrency_;
+        }
+
+        template <class F>
+        void operator()(const F& task) const {
+            std::vector<std::thread> threads;
+
+            try {
+                threads.reserve(concurrency_ - 1);
+            } catch (...) {
+            }
+
+            for (size_t i = 1; i < concurrency_; ++i) {
+                try {
+                    threads.emplace_back(std::cref(task), i);
+                } catch (...) {
+                    task(i);
+                }
+            }
+
+            task(0);
+
+            for (auto& thread : threads) {
+                thread.join();
+            }
+        }
+
+    private:
+        size_t concurrency_;
+    };
+}
@@ -0,0 +1,606 @@
+#pragma once
+
+#include "intrhash.h"
+
+#include <cstring>
+#include <tuple>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace intrhash_flat_priv {
+    constexpr uint8_t empty_tag = 0x80;
+
+    inline unsigned lowest_bit(unsigned mask) noexcept {
+#if defined(__GNUC__)
+        return __builtin_ctz(mask);
+#else
+        unsigned result = 0;
+
+        while (!(mask & 1)) {
+            mask >>= 1;
+            ++result;
+        }
+
+        return result;
+#endif
+    }
+
+    // sixteen consecutive tags; bit i of a mask stands for tags[i]
+    class group_t {
+    public:
+        static constexpr size_t width = 16;
+
+#if defined(__SSE2__)
+        explicit group_t(const uint8_t* tags) noexcept
+            : tags_(_mm_loadu_si128(reinterpret_cast<const __m128i*>(tags)))
+        {}
+
+        unsigned match(uint8_t tag) const noexcept {
+            return static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(tags_, _mm_set1_epi8(static_cast<char>(tag)))));
+        }
+
+        unsigned match_empty() const noexcept {
+            return static_cast<unsigned>(_mm_movemask_epi8(tags_));
+        }
+
+    private:
+        __m128i tags_;
+#else
+        explicit group_t(const uint8_t* tags) noexcept {
+            std::memcpy(tags_, tags, width);
+        }
+
+        unsigned match(uint8_t tag) const noexcept {
+            unsigned result = 0;
+
+            for (size_t i = 0; i != width; ++i) {
+                result |= static_cast<unsigned>(tags_[i] == tag) << i;
+            }
+
+            return result;
+        }
+
+        unsigned match_empty() const noexcept {
+            return match(empty_tag);
+        }
+
+    private:
+        uint8_t tags_[width];
+#endif
+    };
+
+    // what a table without storage points its tags at
+    inline uint8_t* empty_tags() noexcept {
+        static struct empty_tags_t {
+            empty_tags_t() noexcept {
+                std::memset(tags, empty_tag, sizeof(tags));
+            }
+
+            uint8_t tags[2 * group_t::width];
+        } tags;
+
+        return tags.tags;
+    }
+}
+
+// Open addressing with linear probing over inline slots. Every slot has a one
+// byte tag: empty_tag, or seven bits of the hash when it is full. Lookups
+// compare sixteen tags at a time and stop at the first empty one; erase shifts
+// the rest of the run back instead of leaving tombstones, so a long-lived
+// table never degrades and never needs a cleanup rehash.
+//
+// Elements move on rehash and erase, which invalidates iterators and pointers.
+template <class V, class O, class A>
+class intrhash_flat_t {
+private:
+    static_assert(std::is_nothrow_move_constructible<V>::value, "elements are moved by rehash and erase, which must not throw");
+
+    union slot_t {
+        slot_t() noexcept {
+        }
+
+        ~slot_t() noexcept {
+        }
+
+        V value;
+    };
+
+    using slot_allocator_type = typename A::template rebind<slot_t>::other;
+    using tag_allocator_type = typename A::template rebind<uint8_t>::other;
+
+    using group_t = intrhash_flat_priv::group_t;
+
+    struct probe_t {
+        size_t pos;
+        uint8_t tag;
+    };
+
+public:
+    using value_type = V;
+    using allocator_type = typename A::template rebind<V>::other;
+
+private:
+    template <bool X>
+    class iterator_base_t {
+    private:
+        using table_type = intrhash_util::select_type<X, const intrhash_flat_t, intrhash_flat_t>;
+
+    public:
+        using value_type = typename std::remove_reference<decltype(O::extract_value(intrhash_util::declret<intrhash_util::select_type<X, const V&, V&>>()))>::type;
+
+        using reference = value_type&;
+        using pointer = value_type*;
+
+        typedef typename std::forward_iterator_tag iterator_category;
+        typedef typename std::ptrdiff_t difference_type;
+
+    public:
+        iterator_base_t() = default;
+
+        template <bool _X>
+        iterator_base_t(const iterator_base_t<_X>& right) noexcept
+            : table_(right.table())
+            , index_(right.index())
+        {}
+
+        iterator_base_t(table_type* _table, size_t _index) noexcept
+            : table_(_table)
+            , index_(_index)
+        {}
+
+        table_type* table() const noexcept {
+            return table_;
+        }
+
+        size_t index() const noexcept {
+            return index_;
+        }
+
+    public:
+        value_type* operator->() const noexcept {
+            return &O::extract_value(table_->slots_[index_].value);
+        }
+
+        value_type& operator*() const noexcept {
+            return O::extract_value(table_->slots_[index_].value);
+        }
+
+        template <bool _X>
+        bool operator==(const iterator_base_t<_X>& right) const noexcept {
+            return index() == right.index();
+        }
+
+        template <bool _X>
+        bool operator!=(const iterator_base_t<_X>& right) const noexcept {
+            return index() != right.index();
+        }
+
+        iterator_base_t operator++() noexcept {
+            index_ = table_->next_full_(index_ + 1);
+            return *this;
+        }
+
+        iterator_base_t operator++(int) noexcept {
+            const iterator_base_t iter(*this);
+            ++*this;
+            return iter;
+        }
+
+    private:
+        table_type* table_ = nullptr;
+        size_t index_ = 0;
+    };
+
+public:
+    using iterator = iterator_base_t<false>;
+    using const_iterator = iterator_base_t<true>;
+
+public:
+    iterator begin() noexcept {
+        return {this, next_full_(0)};
+    }
+
+    iterator end() noexcept {
+        return {this, capacity_()};
+    }
+
+    const_iterator begin() const noexcept {
+        return {this, next_full_(0)};
+    }
+
+    const_iterator end() const noexcept {
+        return {this, capacity_()};
+    }
+
+    const_iterator cbegin() const noexcept {
+        return begin();
+    }
+
+    const_iterator cend() const noexcept {
+        return end();
+    }
+
+public:
+    template <class K>
+    iterator find(const K& key) noexcept {
+        const std::pair<size_t, bool> found = find_(key, probe_(O::hash(key)));
+        return {this, found.second ? found.first : capacity_()};
+    }
+
+    template <class K>
+    const_iterator find(const K& key) const noexcept {
+        const std::pair<size_t, bool> found = find_(key, probe_(O::hash(key)));
+        return {this, found.second ? found.first : capacity_()};
+    }
+
+    template <class K>
+    bool has(const K& key) const noexcept {
+        return find_(key, probe_(O::hash(key))).second;
+    }
+
+    template <class K>
+    size_t count(const K& key) const noexcept {
+        return has(key);
+    }
+
+    size_t size() const noexcept {
+        return nitems_;
+    }
+
+    bool empty() const noexcept {
+        return !nitems_;
+    }
+
+public:
+    void reserve(size_t n) {
+        if (n > max_items_) {
+            rehash_to_(capacity_for_(n));
+        }
+    }
+
+    void rehash(size_t n) {
+        size_t capacity = capacity_for_(nitems_);
+
+        while (capacity < n) {
+            capacity *= 2;
+        }
+
+        if (capacity != capacity_()) {
+            rehash_to_(capacity);
+        }
+    }
+
+    size_t bucket_count() const noexcept {
+        return capacity_();
+    }
+
+    float load_factor() const noexcept {
+        return capacity_() ? static_cast<float>(nitems_) / capacity_() : 0.0f;
+    }
+
+    float max_load_factor() const noexcept {
+        return 0.8f;
+    }
+
+public:
+    std::pair<iterator, bool> insert(const value_type& value) {
+        return find_or_emplace(O::extract_key(value), value);
+    }
+
+    template <class I>
+    void insert_range(I first, I last) {
+        if (const size_t n = intrhash_util::range_size(first, last)) {
+            reserve(size() + n);
+        }
+
+        for (; first != last; ++first) {
+            insert(*first);
+        }
+    }
+
+    size_t erase(iterator iter) noexcept {
+        erase_(iter.index());
+        return 1;
+    }
+
+    size_t erase(const_iterator iter) noexcept {
+        erase_(iter.index());
+        return 1;
+    }
+
+    template <class K>
+    size_t erase(const K& key) noexcept {
+        const std::pair<size_t, bool> found = find_(key, probe_(O::hash(key)));
+
+        if (found.second) {
+            erase_(found.first);
+            return 1;
+        } else {
+            return 0;
+        }
+    }
+
+    void clear() noexcept {
+        destroy_();
+        nitems_ = 0;
+
+        if (slots_) {
+            std::memset(tags_, intrhash_flat_priv::empty_tag, capacity_() + group_t::width - 1);
+        }
+    }
+
+protected:
+    // constructs value_type(params...) unless key is already there
+    template <class K, class... X>
+    std::pair<iterator, bool> find_or_emplace(const K& key, X&&... params) {
+        const size_t hash = O::hash(key);
+        probe_t probe = probe_(hash);
+        std::pair<size_t, bool> found = find_(key, probe);
+
+        if (found.second) {
+            return {{this, found.first}, false};
+        }
+
+        if (nitems_ >= max_items_) {
+            rehash_to_(capacity_for_(nitems_ + 1));
+            probe = probe_(hash);
+            found.first = find_empty_(probe);
+        }
+
+        new (&slots_[found.first].value) V(std::forward<X>(params)...);
+        set_tag_(found.first, probe.tag);
+        ++nitems_;
+
+        return {{this, found.first}, true};
+    }
+
+private:
+    size_t capacity_() const noexcept {
+        return slots_ ? mask_ + 1 : 0;
+    }
+
+    static size_t capacity_for_(size_t n) noexcept {
+        size_t capacity = group_t::width;
+
+        while (capacity - capacity / 5 < n) {
+            capacity *= 2;
+        }
+
+        return capacity;
+    }
+
+    // fibonacci hashing as in pow2_intrhash_buckets; the tag takes the seven
+    // bits right below the index so that both depend on every bit of the hash
+    probe_t probe_(size_t hash) const noexcept {
+        const uint64_t product = static_cast<uint64_t>(hash) * 0x9e3779b97f4a7c15ull;
+        return {static_cast<size_t>(product >> shift_), static_cast<uint8_t>((product >> (shift_ - 7)) & 0x7f)};
+    }
+
+    template <class K>
+    std::pair<size_t, bool> find_(const K& key, probe_t probe) const noexcept {
+        for (size_t pos = probe.pos;; pos = (pos + group_t::width) & mask_) {
+            const group_t group(tags_ + pos);
+            const unsigned empty = group.match_empty();
+
+            // a run has no holes, so nothing past its first empty slot can match
+            unsigned match = group.match(probe.tag) & (empty ? (empty & (0u - empty)) - 1 : ~0u);
+
+            for (; match; match &= match - 1) {
+                const size_t index = (pos + intrhash_flat_priv::lowest_bit(match)) & mask_;
+
+                if (O::equal_to(O::extract_key(slots_[index].value), key)) {
+                    return {index, true};
+                }
+            }
+
+            if (empty) {
+                return {(pos + intrhash_flat_priv::lowest_bit(empty)) & mask_, false};
+            }
+        }
+    }
+
+    size_t find_empty_(probe_t probe) const noexcept {
+        for (size_t pos = probe.pos;; pos = (pos + group_t::width) & mask_) {
+            if (const unsigned empty = group_t(tags_ + pos).match_empty()) {
+                return (pos + intrhash_flat_priv::lowest_bit(empty)) & mask_;
+            }
+        }
+    }
+
+    size_t next_full_(size_t index) const noexcept {
+        const size_t capacity = capacity_();
+
+        while (index < capacity && tags_[index] == intrhash_flat_priv::empty_tag) {
+            ++index;
+        }
+
+        return index;
+    }
+
+    void set_tag_(size_t index, uint8_t tag) noexcept {
+        tags_[index] = tag;
+
+        // the first width - 1 tags are mirrored past the end, so that a group
+        // starting near the end can be loaded without wrapping
+        if (index < group_t::width - 1) {
+            tags_[index + mask_ + 1] = tag;
+        }
+    }
+
+    // backward shift: pull every following element of the run that may live
+    // at the hole into it, until the run ends
+    void erase_(size_t index) noexcept {
+        slots_[index].value.~V();
+
+        for (size_t next = (index + 1) & mask_; tags_[next] != intrhash_flat_priv::empty_tag; next = (next + 1) & mask_) {
+            const size_t home = probe_(O::hash(O::extract_key(slots_[next].value))).pos;
+
+            if (((next - home) & mask_) >= ((next - index) & mask_)) {
+                new (&slots_[index].value) V(std::move(slots_[next].value));
+                slots_[next].value.~V();
+                set_tag_(index, tags_[next]);
+                index = next;
+            }
+        }
+
+        set_tag_(index, intrhash_flat_priv::empty_tag);
+        --nitems_;
+    }
+
+    void rehash_to_(size_t capacity) {
+        intrhash_flat_t table(allocator_);
+        table.allocate_(capacity);
+
+        for (size_t i = next_full_(0); i != capacity_(); i = next_full_(i + 1)) {
+            const probe_t probe = table.probe_(O::hash(O::extract_key(slots_[i].value)));
+            const size_t index = table.find_empty_(probe);
+
+            new (&table.slots_[index].value) V(std::move(slots_[i].value));
+            table.set_tag_(index, probe.tag);
+        }
+
+        table.nitems_ = nitems_;
+        swap(table);
+    }
+
+    void allocate_(size_t capacity) {
+        tag_allocator_type tag_allocator(allocator_);
+        tags_ = tag_allocator.allocate(capacity + group_t::width - 1);
+
+        try {
+            slots_ = allocator_.allocate(capacity);
+        } catch (...) {
+            tag_allocator.deallocate(tags_, capacity + group_t::width - 1);
+            tags_ = intrhash_flat_priv::empty_tags();
+            throw;
+        }
+
+        std::memset(tags_, intrhash_flat_priv::empty_tag, capacity + group_t::width - 1);
+
+        mask_ = capacity - 1;
+        shift_ = 64;
+        max_items_ = capacity - capacity / 5;
+
+        while (capacity >>= 1) {
+            --shift_;
+        }
+    }
+
+    void deallocate_() noexcept {
+        if (slots_) {
+            const size_t capacity = capacity_();
+
+            allocator_.deallocate(slots_, capacity);
+            tag_allocator_type(allocator_).deallocate(tags_, capacity + group_t::width - 1);
+        }
+    }
+
+    void destroy_() noexcept {
+        if (!std::is_trivially_destructible<V>::value) {
+            for (size_t i = next_full_(0); i != capacity_(); i = next_full_(i + 1)) {
+                slots_[i].value.~V();
+            }
+        }
+    }
+
+public:
+    intrhash_flat_t() = default;
+
+    explicit intrhash_flat_t(size_t n) {
+        reserve(n);
+    }
+
+    intrhash_flat_t(size_t n, const allocator_type& allocator)
+        : allocator_(allocator)
+    {
+        reserve(n);
+    }
+
+    template <class I, class = intrhash_util::enable_if_iterator<I>>
+    intrhash_flat_t(I first, I last) {
+        insert_range(first, last);
+    }
+
+    // the allocator is copied, not moved, so that both tables keep a usable one
+    intrhash_flat_t(intrhash_flat_t&& right) noexcept
+        : allocator_(right.allocator_)
+    {
+        swap_data_(right);
+    }
+
+    intrhash_flat_t(const intrhash_flat_t& right)
+        : allocator_(right.allocator_)
+    {
+        if (right.slots_) {
+            allocate_(right.capacity_());
+
+            for (size_t i = right.next_full_(0); i != right.capacity_(); i = right.next_full_(i + 1)) {
+                try {
+                    new (&slots_[i].value) V(right.slots_[i].value);
+                } catch (...) {
+                    destroy_();
+                    deallocate_();
+                    throw;
+                }
+
+                set_tag_(i, right.tags_[i]);
+            }
+
+            nitems_ = right.nitems_;
+        }
+    }
+
+    ~intrhash_flat_t() noexcept {
+        destroy_();
+        deallocate_();
+    }
+
+private:
+    explicit intrhash_flat_t(const slot_allocator_type& allocator)
+        : allocator_(allocator)
+    {}
+
+public:
+    allocator_type get_allocator() const noexcept {
+        return allocator_type(allocator_);
+    }
+
+    void swap(intrhash_flat_t& right) noexcept {
+        std::swap(allocator_, right.allocator_);
+        swap_data_(right);
+    }
+
+    intrhash_flat_t& operator=(const intrhash_flat_t& right) {
+        intrhash_flat_t(right).swap(*this);
+        return *this;
+    }
+
+    intrhash_flat_t& operator=(intrhash_flat_t&& right) noexcept {
+        intrhash_flat_t(std::move(right)).swap(*this);
+        return *this;
+    }
+
+private:
+    void swap_data_(intrhash_flat_t& right) noexcept {
+        std::swap(tags_, right.tags_);
+        std::swap(slots_, right.slots_);
+        std::swap(mask_, right.mask_);
+        std::swap(shift_, right.shift_);
+        std::swap(nitems_, right.nitems_);
+        std::swap(max_items_, right.max_items_);
+    }
+
+private:
+    slot_allocator_type allocator_;
+
+    uint8_t* tags_ = intrhash_flat_priv::empty_tags();
+    slot_t* slots_ = nullptr;
+
+    size_t mask_ = 0;
+    unsigned shift_ = 63;
+
+    size_t nitems_ = 0;
+    size_t max_items_ = 0;
+};
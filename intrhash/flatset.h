@@ -0,0 +1,90 @@
+#pragma once
+
+#include "flat.h"
+
+namespace intrhash_flat_set_priv {
+    template <class T, class O, class A>
+    struct impl {
+        using value_type = T;
+
+        struct ops
+            : public O
+        {
+            static const value_type& extract_key(const value_type& value) noexcept {
+                return value;
+            }
+
+            static const value_type& extract_value(const value_type& value) noexcept {
+                return value;
+            }
+        };
+
+        using impl_type = intrhash_flat_t<value_type, ops, A>;
+    };
+}
+
+// intrhash_set_t with the values stored inline; meant for small values
+template <class T, class O = generic_intrhash_ops, class A = std::allocator<T>>
+class intrhash_flat_set_t
+    : private intrhash_flat_set_priv::impl<T, O, A>::impl_type
+{
+private:
+    using priv_impl = typename intrhash_flat_set_priv::impl<T, O, A>;
+
+    using impl_type = typename priv_impl::impl_type;
+
+public:
+    using value_type = typename priv_impl::value_type;
+
+public:
+    using iterator = typename impl_type::iterator;
+    using const_iterator = typename impl_type::const_iterator;
+
+public:
+    using impl_type::get_allocator;
+
+    using impl_type::begin;
+    using impl_type::end;
+    using impl_type::cbegin;
+    using impl_type::cend;
+
+    using impl_type::find;
+    using impl_type::has;
+    using impl_type::count;
+
+    using impl_type::size;
+    using impl_type::empty;
+
+    using impl_type::reserve;
+    using impl_type::rehash;
+    using impl_type::bucket_count;
+    using impl_type::load_factor;
+    using impl_type::max_load_factor;
+
+    using impl_type::insert;
+    using impl_type::insert_range;
+    using impl_type::erase;
+    using impl_type::clear;
+
+public:
+    intrhash_flat_set_t() = default;
+
+    explicit intrhash_flat_set_t(size_t n)
+        : impl_type(n)
+    {}
+
+    template <class X>
+    explicit intrhash_flat_set_t(size_t n, X&& allocator_param)
+        : impl_type(n, std::forward<X>(allocator_param))
+    {}
+
+    template <class I, class = intrhash_util::enable_if_iterator<I>>
+    intrhash_flat_set_t(I first, I last)
+        : impl_type(first, last)
+    {}
+
+public:
+    void swap(intrhash_flat_set_t& right) noexcept {
+        impl_type::swap(right);
+    }
+};
@@ -0,0 +1,406 @@
+#pragma once
+
+#include "intrhash.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <system_error>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define INTRHASH_FROZEN_MMAP 1
+#endif
+
+// Image layout, in native byte order, every section aligned to align:
+//   header_t
+//   uint64_t buckets[nbuckets + 1]  entries of bucket i are [buckets[i], buckets[i + 1])
+//   uint64_t hashes[nentries]
+//   entry_t entries[nentries]
+// Offsets are relative to the start of the image, so it can live at any address.
+namespace intrhash_frozen_priv {
+    constexpr char magic[8] = {'i', 'n', 't', 'r', 'h', 'f', 'z', '\1'};
+    constexpr uint32_t version = 1;
+    constexpr uint64_t align = 64;
+
+    struct header_t {
+        char magic[8];
+        uint32_t version;
+        uint32_t entry_size;
+        uint64_t nbuckets;
+        uint64_t nentries;
+        uint64_t buckets_offset;
+        uint64_t hashes_offset;
+        uint64_t entries_offset;
+        uint64_t image_size;
+    };
+
+    inline uint64_t aligned(uint64_t offset) noexcept {
+        return (offset + align - 1) & ~(align - 1);
+    }
+
+    // fills in the offsets and the size from nbuckets, nentries and entry_size
+    inline void layout(header_t* header) noexcept {
+        header->buckets_offset = aligned(sizeof(header_t));
+        header->hashes_offset = aligned(header->buckets_offset + (header->nbuckets + 1) * sizeof(uint64_t));
+        header->entries_offset = aligned(header->hashes_offset + header->nentries * sizeof(uint64_t));
+        header->image_size = header->entries_offset + header->nentries * header->entry_size;
+    }
+
+    // read-only shared mapping of a whole file
+    class mapping_t {
+    public:
+        mapping_t() = default;
+
+#if defined(INTRHASH_FROZEN_MMAP)
+        explicit mapping_t(const char* path) {
+            const int fd = ::open(path, O_RDONLY);
+
+            if (fd < 0) {
+                throw std::system_error(errno, std::generic_category(), path);
+            }
+
+            struct stat st;
+
+            if (::fstat(fd, &st) != 0) {
+                const int error = errno;
+                ::close(fd);
+                throw std::system_error(error, std::generic_category(), path);
+            }
+
+            size_ = static_cast<size_t>(st.st_size);
+            data_ = size_ ? ::mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0) : nullptr;
+
+            const int error = errno;
+            ::close(fd);
+
+            if (data_ == MAP_FAILED) {
+                data_ = nullptr;
+                throw std::system_error(error, std::generic_category(), path);
+            }
+        }
+
+        ~mapping_t() noexcept {
+            if (data_) {
+                ::munmap(data_, size_);
+            }
+        }
+#endif
+
+        mapping_t(mapping_t&& right) noexcept {
+            swap(right);
+        }
+
+        mapping_t& operator=(mapping_t&& right) noexcept {
+            mapping_t(std::move(right)).swap(*this);
+            return *this;
+        }
+
+        void swap(mapping_t& right) noexcept {
+            std::swap(data_, right.data_);
+            std::swap(size_, right.size_);
+        }
+
+        const void* data() const noexcept {
+            return data_;
+        }
+
+        size_t size() const noexcept {
+            return size_;
+        }
+
+    private:
+        void* data_ = nullptr;
+        size_t size_ = 0;
+    };
+}
+
+template <class K, class T>
+struct intrhash_frozen_entry_t {
+    K first;
+    T second;
+};
+
+// A read-only map served straight from a saved image: buckets are ranges of
+// one sorted entry array instead of chains, and nothing is rebuilt on open:
+// opening reads only the bucket offsets, to check them, and processes mapping
+// the same file share its pages. K and T must be trivially copyable and O::hash must give
+// the same values in the writing and the reading process.
+template <class K, class T, class O = generic_intrhash_ops>
+class intrhash_frozen_map_t {
+public:
+    using value_type = intrhash_frozen_entry_t<K, T>;
+
+    using iterator = const value_type*;
+    using const_iterator = const value_type*;
+
+private:
+    static_assert(std::is_trivially_copyable<K>::value && std::is_trivially_copyable<T>::value, "frozen images hold raw bytes of keys and values");
+
+    using header_t = intrhash_frozen_priv::header_t;
+    using shape_type = pow2_intrhash_buckets;
+
+public:
+    const_iterator begin() const noexcept {
+        return entries_;
+    }
+
+    const_iterator end() const noexcept {
+        return entries_ + size();
+    }
+
+    template <class _K>
+    const value_type* find(const _K& key) const noexcept {
+        const auto range = equal_range(key);
+        return range.first != range.second ? range.first : nullptr;
+    }
+
+    template <class _K>
+    bool has(const _K& key) const noexcept {
+        return find(key);
+    }
+
+    template <class _K>
+    size_t count(const _K& key) const noexcept {
+        const auto range = equal_range(key);
+        return range.second - range.first;
+    }
+
+    // equal keys are adjacent, as they were in the saved range
+    template <class _K>
+    std::pair<const value_type*, const value_type*> equal_range(const _K& key) const noexcept {
+        if (!header_ || !header_->nentries) {
+            return {end(), end()};
+        }
+
+        const uint64_t hash = O::hash(key);
+        const size_t bucket = shape_.index(hash);
+
+        for (uint64_t i = buckets_[bucket], last = buckets_[bucket + 1]; i != last; ++i) {
+            if (hashes_[i] == hash && O::equal_to(entries_[i].first, key)) {
+                uint64_t j = i + 1;
+
+                while (j != last && hashes_[j] == hash && O::equal_to(entries_[j].first, key)) {
+                    ++j;
+                }
+
+                return {entries_ + i, entries_ + j};
+            }
+        }
+
+        return {end(), end()};
+    }
+
+    size_t size() const noexcept {
+        return header_ ? header_->nentries : 0;
+    }
+
+    bool empty() const noexcept {
+        return !size();
+    }
+
+    size_t bucket_count() const noexcept {
+        return header_ ? header_->nbuckets : 0;
+    }
+
+public:
+    // writes [first, last) of value_type-like pairs; equal keys must be
+    // adjacent, as every intrhash container iterates them
+    template <class I>
+    static void save(std::FILE* file, I first, I last) {
+        struct row_t {
+            uint64_t hash;
+            size_t bucket;
+            value_type entry;
+        };
+
+        std::vector<row_t> rows;
+
+        for (; first != last; ++first) {
+            row_t row;
+
+            // no stray padding bytes in the image
+            std::memset(&row, 0, sizeof(row));
+            row.hash = O::hash(first->first);
+            row.entry.first = first->first;
+            row.entry.second = first->second;
+            rows.push_back(row);
+        }
+
+        const shape_type shape(rows.size());
+
+        for (auto& row : rows) {
+            row.bucket = shape.index(row.hash);
+        }
+
+        std::stable_sort(rows.begin(), rows.end(), [](const row_t& left, const row_t& right){
+            return left.bucket < right.bucket;
+        });
+
+        header_t header;
+        std::memset(&header, 0, sizeof(header));
+        std::memcpy(header.magic, intrhash_frozen_priv::magic, sizeof(header.magic));
+        header.version = intrhash_frozen_priv::version;
+        header.entry_size = sizeof(value_type);
+        header.nbuckets = shape.size();
+        header.nentries = rows.size();
+        intrhash_frozen_priv::layout(&header);
+
+        std::vector<uint64_t> buckets(header.nbuckets + 1);
+        std::vector<uint64_t> hashes;
+
+        hashes.reserve(rows.size());
+
+        for (const auto& row : rows) {
+            ++buckets[row.bucket + 1];
+            hashes.push_back(row.hash);
+        }
+
+        for (size_t i = 0; i != header.nbuckets; ++i) {
+            buckets[i + 1] += buckets[i];
+        }
+
+        uint64_t offset = 0;
+
+        const auto write = [file, &offset](uint64_t at, const void* data, size_t size){
+            static const char zeros[intrhash_frozen_priv::align] = {};
+
+            while (offset < at) {
+                const size_t n = static_cast<size_t>(std::min<uint64_t>(at - offset, sizeof(zeros)));
+                write_(file, zeros, n);
+                offset += n;
+            }
+
+            write_(file, data, size);
+            offset += size;
+        };
+
+        write(0, &header, sizeof(header));
+        write(header.buckets_offset, buckets.data(), buckets.size() * sizeof(uint64_t));
+        write(header.hashes_offset, hashes.data(), hashes.size() * sizeof(uint64_t));
+        write(header.entries_offset, nullptr, 0);
+
+        for (const auto& row : rows) {
+            write(offset, &row.entry, sizeof(row.entry));
+        }
+
+        if (std::fflush(file) != 0) {
+            throw std::system_error(errno, std::generic_category(), "intrhash_frozen_map_t::save");
+        }
+    }
+
+    template <class M>
+    static void save(const char* path, const M& map) {
+        std::FILE* const file = std::fopen(path, "wb");
+
+        if (!file) {
+            throw std::system_error(errno, std::generic_category(), path);
+        }
+
+        try {
+            save(file, map.begin(), map.end());
+        } catch (...) {
+            std::fclose(file);
+            throw;
+        }
+
+        if (std::fclose(file) != 0) {
+            throw std::system_error(errno, std::generic_category(), path);
+        }
+    }
+
+private:
+    static void write_(std::FILE* file, const void* data, size_t size) {
+        if (size && std::fwrite(data, 1, size, file) != size) {
+            throw std::system_error(errno, std::generic_category(), "intrhash_frozen_map_t::save");
+        }
+    }
+
+    void attach_(const void* image, size_t size) {
+        const char* const base = static_cast<const char*>(image);
+        const header_t* const header = static_cast<const header_t*>(image);
+
+        if (size < sizeof(header_t) || std::memcmp(header->magic, intrhash_frozen_priv::magic, sizeof(header->magic)) != 0) {
+            throw std::invalid_argument("intrhash_frozen_map_t: not a frozen image");
+        }
+
+        if (header->version != intrhash_frozen_priv::version || header->entry_size != sizeof(value_type)) {
+            throw std::invalid_argument("intrhash_frozen_map_t: incompatible image");
+        }
+
+        header_t expected = *header;
+        intrhash_frozen_priv::layout(&expected);
+
+        if (header->nbuckets > size / sizeof(uint64_t) || header->nentries > size / sizeof(uint64_t) || shape_type(header->nbuckets).size() != header->nbuckets
+            || std::memcmp(&expected, header, sizeof(expected)) != 0 || header->image_size > size)
+        {
+            throw std::invalid_argument("intrhash_frozen_map_t: corrupt or truncated image");
+        }
+
+        if (reinterpret_cast<uintptr_t>(base + header->entries_offset) % alignof(value_type)) {
+            throw std::invalid_argument("intrhash_frozen_map_t: misaligned image");
+        }
+
+        const uint64_t* const buckets = reinterpret_cast<const uint64_t*>(base + header->buckets_offset);
+
+        // lookups index the entries by these without further checks
+        for (uint64_t i = 0, last = 0; i != header->nbuckets + 1; last = buckets[i++]) {
+            if (buckets[i] < last || buckets[i] > header->nentries) {
+                throw std::invalid_argument("intrhash_frozen_map_t: corrupt or truncated image");
+            }
+        }
+
+        header_ = header;
+        shape_ = shape_type(header->nbuckets);
+        buckets_ = buckets;
+        hashes_ = reinterpret_cast<const uint64_t*>(base + header->hashes_offset);
+        entries_ = reinterpret_cast<const value_type*>(base + header->entries_offset);
+    }
+
+public:
+    intrhash_frozen_map_t() = default;
+
+    // serves from memory the caller keeps alive, e.g. a mapping of its own
+    intrhash_frozen_map_t(const void* image, size_t size) {
+        attach_(image, size);
+    }
+
+#if defined(INTRHASH_FROZEN_MMAP)
+    explicit intrhash_frozen_map_t(const char* path)
+        : mapping_(path)
+    {
+        attach_(mapping_.data(), mapping_.size());
+    }
+#endif
+
+    intrhash_frozen_map_t(intrhash_frozen_map_t&& right) noexcept {
+        swap(right);
+    }
+
+    intrhash_frozen_map_t& operator=(intrhash_frozen_map_t&& right) noexcept {
+        intrhash_frozen_map_t(std::move(right)).swap(*this);
+        return *this;
+    }
+
+    void swap(intrhash_frozen_map_t& right) noexcept {
+        mapping_.swap(right.mapping_);
+        std::swap(header_, right.header_);
+        std::swap(shape_, right.shape_);
+        std::swap(buckets_, right.buckets_);
+        std::swap(hashes_, right.hashes_);
+        std::swap(entries_, right.entries_);
+    }
+
+private:
+    intrhash_frozen_priv::mapping_t mapping_;
+
+    const header_t* header_ = nullptr;
+    shape_type shape_;
+    const uint64_t* buckets_ = nullptr;
+    const uint64_t* hashes_ = nullptr;
+    const value_type* entries_ = nullptr;
+};
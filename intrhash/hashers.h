@@ -0,0 +1,372 @@
+#pragma once
+
+#include "intrhash.h"
+
+#include <cstring>
+#include <string_view>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#if defined(_MSC_VER) && defined(_M_X64)
+#include <intrin.h>
+#endif
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+#define INTRHASH_HASH_AVX2 1
+#endif
+
+// Hashes depend on nothing but the bytes of the key: no seed, words are read
+// little endian on every host, and the AVX2 and the portable code compute the
+// same values, so a hash saved in a frozen image holds on any machine.
+namespace intrhash_hash_priv {
+    constexpr uint64_t secret[16] = {
+        0x2d358dccaa6c78a5ull, 0x8bb84b93962eacc9ull, 0x4b33a62ed433d4a3ull, 0x4d5a2da51de1aa47ull,
+        0xa0761d6478bd642full, 0xe7037ed1a0b428dbull, 0x8ebc6af09c88c6e3ull, 0x589965cc75374cc3ull,
+        0x1d8e4e27c47d124full, 0xbe4ba423396cfeb8ull, 0xdb979083e96dd4deull, 0x7c01812cf721ad1cull,
+        0x1f67b3b7a4a44072ull, 0x78e5c0cc4ee679cbull, 0xc2b5ae5b5a5c1d9cull, 0x33cdef1d2a1f4e67ull,
+    };
+
+    // little endian on any host, and usable at compile time; compilers fold
+    // the bytes of read32() and read64() back into one load
+    template <class C>
+    constexpr uint64_t read8(const C* ptr, size_t i) noexcept {
+        return static_cast<uint64_t>(static_cast<unsigned char>(ptr[i])) << (8 * i);
+    }
+
+    template <class C>
+    constexpr uint64_t read32(const C* ptr) noexcept {
+        return read8(ptr, 0) | read8(ptr, 1) | read8(ptr, 2) | read8(ptr, 3);
+    }
+
+    template <class C>
+    constexpr uint64_t read64(const C* ptr) noexcept {
+        return read32(ptr) | (read32(ptr + 4) << 32);
+    }
+
+#if defined(__SIZEOF_INT128__)
+    __extension__ typedef unsigned __int128 u128;
+#endif
+
+    // the two halves of the 128 bit product folded together
+    constexpr uint64_t mum(uint64_t a, uint64_t b) noexcept {
+#if defined(__SIZEOF_INT128__)
+        const u128 product = static_cast<u128>(a) * b;
+        return static_cast<uint64_t>(product) ^ static_cast<uint64_t>(product >> 64);
+#elif defined(_MSC_VER) && defined(_M_X64)
+        uint64_t high;
+        const uint64_t low = _umul128(a, b, &high);
+        return low ^ high;
+#else
+        const uint64_t a_lo = a & 0xffffffff, a_hi = a >> 32;
+        const uint64_t b_lo = b & 0xffffffff, b_hi = b >> 32;
+        const uint64_t lo_lo = a_lo * b_lo, hi_lo = a_hi * b_lo, lo_hi = a_lo * b_hi, hi_hi = a_hi * b_hi;
+        const uint64_t cross = (lo_lo >> 32) + (hi_lo & 0xffffffff) + lo_hi;
+        return ((cross << 32) | (lo_lo & 0xffffffff)) ^ (hi_hi + (hi_lo >> 32) + (cross >> 32));
+#endif
+    }
+
+    constexpr uint64_t mix(uint64_t value) noexcept {
+        return mum(value ^ secret[0], secret[1]);
+    }
+
+    // wyhash: up to 16 bytes in two overlapping reads, longer keys 48 bytes a round
+    template <class C>
+    constexpr uint64_t hash_short(const C* ptr, size_t len) noexcept {
+        uint64_t seed = mum(secret[0], secret[1]);
+        uint64_t a = 0;
+        uint64_t b = 0;
+
+        if (len <= 16) {
+            if (len >= 4) {
+                const size_t step = (len >> 3) << 2;
+                a = (read32(ptr) << 32) | read32(ptr + step);
+                b = (read32(ptr + len - 4) << 32) | read32(ptr + len - 4 - step);
+            } else if (len) {
+                a = (read8(ptr, 0) << 16) | (read8(ptr + (len >> 1), 0) << 8) | read8(ptr + len - 1, 0);
+            }
+        } else {
+            size_t left = len;
+
+            if (left > 48) {
+                uint64_t seed1 = seed;
+                uint64_t seed2 = seed;
+
+                do {
+                    seed = mum(read64(ptr) ^ secret[1], read64(ptr + 8) ^ seed);
+                    seed1 = mum(read64(ptr + 16) ^ secret[2], read64(ptr + 24) ^ seed1);
+                    seed2 = mum(read64(ptr + 32) ^ secret[3], read64(ptr + 40) ^ seed2);
+                    ptr += 48;
+                    left -= 48;
+                } while (left > 48);
+
+                seed ^= seed1 ^ seed2;
+            }
+
+            while (left > 16) {
+                seed = mum(read64(ptr) ^ secret[1], read64(ptr + 8) ^ seed);
+                ptr += 16;
+                left -= 16;
+            }
+
+            a = read64(ptr + left - 16);
+            b = read64(ptr + left - 8);
+        }
+
+        return mum(mum(a ^ secret[1], b ^ seed) ^ secret[0] ^ len, secret[1]);
+    }
+
+    // Long keys go through eight 64 bit lanes, xxh3 style, one 64 byte stripe
+    // at a time: lane i adds the 32x32 bit product of its word mixed with the
+    // secret, and lane i ^ 1 adds the raw word. Every 8 stripes the lanes are
+    // scrambled. The kernels only differ in how many lanes an instruction takes.
+    constexpr size_t stripe_size = 64;
+    constexpr size_t block_stripes = 8;
+    constexpr size_t block_size = stripe_size * block_stripes;
+    constexpr uint64_t scramble_prime = 0x9e3779b1;
+
+    struct scalar_kernel {
+        static void accumulate(uint64_t* acc, const unsigned char* ptr, size_t nstripes, const uint64_t* key) noexcept {
+            for (size_t n = 0; n != nstripes; ++n, ptr += stripe_size, ++key) {
+                for (size_t i = 0; i != 8; ++i) {
+                    const uint64_t data = read64(ptr + 8 * i);
+                    const uint64_t mixed = data ^ key[i];
+                    acc[i ^ 1] += data;
+                    acc[i] += (mixed & 0xffffffff) * (mixed >> 32);
+                }
+            }
+        }
+
+        static void scramble(uint64_t* acc, const uint64_t* key) noexcept {
+            for (size_t i = 0; i != 8; ++i) {
+                acc[i] = (acc[i] ^ (acc[i] >> 47) ^ key[i]) * scramble_prime;
+            }
+        }
+    };
+
+#if defined(INTRHASH_HASH_AVX2)
+    struct avx2_kernel {
+        __attribute__((target("avx2"), always_inline))
+        static inline __m256i lanes(__m256i acc, __m256i data, __m256i key) noexcept {
+            const __m256i mixed = _mm256_xor_si256(data, key);
+            const __m256i product = _mm256_mul_epu32(mixed, _mm256_srli_epi64(mixed, 32));
+            const __m256i swapped = _mm256_shuffle_epi32(data, _MM_SHUFFLE(1, 0, 3, 2));
+            return _mm256_add_epi64(_mm256_add_epi64(acc, swapped), product);
+        }
+
+        __attribute__((target("avx2")))
+        static void accumulate(uint64_t* acc, const unsigned char* ptr, size_t nstripes, const uint64_t* key) noexcept {
+            __m256i acc0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(acc));
+            __m256i acc1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(acc + 4));
+
+            for (size_t n = 0; n != nstripes; ++n, ptr += stripe_size, ++key) {
+                acc0 = lanes(acc0, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(ptr)), _mm256_loadu_si256(reinterpret_cast<const __m256i*>(key)));
+                acc1 = lanes(acc1, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(ptr + 32)), _mm256_loadu_si256(reinterpret_cast<const __m256i*>(key + 4)));
+            }
+
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(acc), acc0);
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(acc + 4), acc1);
+        }
+
+        __attribute__((target("avx2")))
+        static void scramble(uint64_t* acc, const uint64_t* key) noexcept {
+            const __m256i prime = _mm256_set1_epi64x(scramble_prime);
+
+            for (size_t i = 0; i != 8; i += 4) {
+                __m256i lanes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(acc + i));
+                lanes = _mm256_xor_si256(lanes, _mm256_srli_epi64(lanes, 47));
+                lanes = _mm256_xor_si256(lanes, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(key + i)));
+
+                const __m256i low = _mm256_mul_epu32(lanes, prime);
+                const __m256i high = _mm256_mul_epu32(_mm256_srli_epi64(lanes, 32), prime);
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(acc + i), _mm256_add_epi64(low, _mm256_slli_epi64(high, 32)));
+            }
+        }
+    };
+#endif
+
+    // more than short_max bytes; the last stripe is read from the end of the key
+    template <class X>
+    uint64_t hash_long(const unsigned char* ptr, size_t len) noexcept {
+        uint64_t acc[8] = {secret[4], secret[5], secret[6], secret[7], secret[8], secret[9], secret[10], secret[11]};
+
+        const size_t nblocks = (len - 1) / block_size;
+
+        for (size_t i = 0; i != nblocks; ++i) {
+            X::accumulate(acc, ptr + i * block_size, block_stripes, secret);
+            X::scramble(acc, secret + 8);
+        }
+
+        X::accumulate(acc, ptr + nblocks * block_size, (len - 1 - nblocks * block_size) / stripe_size, secret);
+        X::accumulate(acc, ptr + len - stripe_size, 1, secret + 7);
+
+        uint64_t result = len * 0x9e3779b97f4a7c15ull;
+
+        for (size_t i = 0; i != 8; i += 2) {
+            result += mum(acc[i] ^ secret[i], acc[i + 1] ^ secret[i + 1]);
+        }
+
+        return mix(result);
+    }
+
+    constexpr size_t short_max = 256;
+
+    inline uint64_t hash_long(const unsigned char* ptr, size_t len) noexcept {
+#if defined(__AVX2__)
+        return hash_long<avx2_kernel>(ptr, len);
+#elif defined(INTRHASH_HASH_AVX2)
+        static const bool avx2 = [](){
+            __builtin_cpu_init();
+            return __builtin_cpu_supports("avx2") != 0;
+        }();
+
+        return avx2 ? hash_long<avx2_kernel>(ptr, len) : hash_long<scalar_kernel>(ptr, len);
+#else
+        return hash_long<scalar_kernel>(ptr, len);
+#endif
+    }
+
+    inline uint64_t hash_bytes(const void* data, size_t len) noexcept {
+        const unsigned char* const ptr = static_cast<const unsigned char*>(data);
+        return len <= short_max ? hash_short(ptr, len) : hash_long(ptr, len);
+    }
+
+    // the same as hash_bytes(); keys up to short_max bytes hash at compile time
+    constexpr uint64_t hash_chars(const char* ptr, size_t len) noexcept {
+        return len <= short_max ? hash_short(ptr, len) : hash_long(reinterpret_cast<const unsigned char*>(ptr), len);
+    }
+
+    // N bytes at a and b; N is known at compile time, so the branches fold
+    template <size_t N>
+    bool bytes_equal(const void* a, const void* b) noexcept {
+        const unsigned char* const left = static_cast<const unsigned char*>(a);
+        const unsigned char* const right = static_cast<const unsigned char*>(b);
+
+#if defined(__AVX2__)
+        if constexpr (N >= 32 && N <= 128) {
+            __m256i diff = _mm256_setzero_si256();
+
+            for (size_t i = 0; i + 32 <= N; i += 32) {
+                diff = _mm256_or_si256(diff, _mm256_xor_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(left + i)), _mm256_loadu_si256(reinterpret_cast<const __m256i*>(right + i))));
+            }
+
+            if constexpr (N % 32 != 0) {
+                diff = _mm256_or_si256(diff, _mm256_xor_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(left + N - 32)), _mm256_loadu_si256(reinterpret_cast<const __m256i*>(right + N - 32))));
+            }
+
+            return _mm256_testz_si256(diff, diff);
+        }
+#endif
+
+#if defined(__SSE2__)
+        if constexpr (N >= 16 && N <= 64) {
+            __m128i diff = _mm_setzero_si128();
+
+            for (size_t i = 0; i + 16 <= N; i += 16) {
+                diff = _mm_or_si128(diff, _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(left + i)), _mm_loadu_si128(reinterpret_cast<const __m128i*>(right + i))));
+            }
+
+            if constexpr (N % 16 != 0) {
+                diff = _mm_or_si128(diff, _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(left + N - 16)), _mm_loadu_si128(reinterpret_cast<const __m128i*>(right + N - 16))));
+            }
+
+            return _mm_movemask_epi8(_mm_cmpeq_epi8(diff, _mm_setzero_si128())) == 0xffff;
+        }
+#endif
+
+        if constexpr (N >= 8 && N <= 16) {
+            return ((read64(left) ^ read64(right)) | (read64(left + N - 8) ^ read64(right + N - 8))) == 0;
+        } else {
+            return std::memcmp(left, right, N) == 0;
+        }
+    }
+
+    template <class K>
+    constexpr bool is_string = std::is_convertible<const K&, std::string_view>::value;
+
+    template <class K>
+    constexpr bool is_integer = std::is_integral<K>::value || std::is_enum<K>::value || std::is_pointer<K>::value;
+
+    // keys compared by their bytes must have no padding and no float fields
+    template <class K>
+    constexpr bool is_pod = std::has_unique_object_representations<K>::value && !is_integer<K>;
+
+    template <class K>
+    constexpr uint64_t integer_bits(K key) noexcept {
+        if constexpr (std::is_pointer<K>::value) {
+            return static_cast<uint64_t>(reinterpret_cast<uintptr_t>(key));
+        } else if constexpr (std::is_enum<K>::value) {
+            return static_cast<uint64_t>(static_cast<typename std::underlying_type<K>::type>(key));
+        } else {
+            return static_cast<uint64_t>(key);
+        }
+    }
+}
+
+// integers, enums and pointers: one 64x64 -> 128 bit multiply, folded; keys of
+// different integer types with the same value hash alike
+struct intrhash_int_ops: public generic_intrhash_ops {
+    template <class K>
+    static constexpr size_t hash(const K& key) noexcept {
+        static_assert(intrhash_hash_priv::is_integer<K>, "intrhash_int_ops takes integers, enums and pointers");
+        return static_cast<size_t>(intrhash_hash_priv::mix(intrhash_hash_priv::integer_bits(key)));
+    }
+};
+
+// anything convertible to std::string_view, so lookups by const char* or
+// std::string_view need no temporary std::string
+struct intrhash_string_ops: public generic_intrhash_ops {
+    static constexpr size_t hash(std::string_view key) noexcept {
+        return static_cast<size_t>(intrhash_hash_priv::hash_chars(key.data(), key.size()));
+    }
+
+    template <class T1, class T2>
+    static constexpr bool equal_to(const T1& first, const T2& second) noexcept {
+        return std::string_view(first) == std::string_view(second);
+    }
+};
+
+// trivially copyable keys without padding, hashed and compared as raw bytes
+struct intrhash_pod_ops: public generic_intrhash_ops {
+    template <class K>
+    static size_t hash(const K& key) noexcept {
+        static_assert(intrhash_hash_priv::is_pod<K>, "intrhash_pod_ops takes keys without padding or floating point fields");
+        return static_cast<size_t>(intrhash_hash_priv::hash_bytes(&key, sizeof(K)));
+    }
+
+    template <class K>
+    static bool equal_to(const K& first, const K& second) noexcept {
+        static_assert(intrhash_hash_priv::is_pod<K>, "intrhash_pod_ops takes keys without padding or floating point fields");
+        return intrhash_hash_priv::bytes_equal<sizeof(K)>(&first, &second);
+    }
+};
+
+// picks one of the above by key type; other keys get std::hash, mixed; string
+// and integer keys hash at compile time as well
+struct intrhash_fast_ops: public generic_intrhash_ops {
+    template <class K>
+    static constexpr size_t hash(const K& key) {
+        if constexpr (intrhash_hash_priv::is_string<K>) {
+            return intrhash_string_ops::hash(key);
+        } else if constexpr (intrhash_hash_priv::is_integer<K>) {
+            return intrhash_int_ops::hash(key);
+        } else if constexpr (intrhash_hash_priv::is_pod<K>) {
+            return intrhash_pod_ops::hash(key);
+        } else {
+            return static_cast<size_t>(intrhash_hash_priv::mix(std::hash<K>()(key)));
+        }
+    }
+
+    template <class T1, class T2>
+    static constexpr bool equal_to(const T1& first, const T2& second) {
+        if constexpr (intrhash_hash_priv::is_string<T1> && intrhash_hash_priv::is_string<T2>) {
+            return intrhash_string_ops::equal_to(first, second);
+        } else if constexpr (std::is_same<T1, T2>::value && intrhash_hash_priv::is_pod<T1>) {
+            return intrhash_pod_ops::equal_to(first, second);
+        } else {
+            return first == second;
+        }
+    }
+};
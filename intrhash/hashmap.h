@@ -2,23 +2,31 @@
 
 #include "intrhash.h"
 #include "nodeallc.h"
+#include "snapshot.h"
+
+#include <tuple>
 
 namespace intrhash_map_priv {
-    template <class K, class T, class O, class A>
+    template <class K, class T, class O, class A, class P>
     struct impl {
         using value_type = std::pair<const K, T>;
 
         struct node_t
             : public value_type
-            , public intrhash_item_t<node_t>
+            , public P::template item<node_t>
         {
             node_t(const value_type& value)
                 : value_type(value)
             {}
 
-            template <class _K>
-            node_t(const _K& key)
-                : value_type(key, T())
+            node_t(value_type&& value)
+                : value_type(std::move(value))
+            {}
+
+            // any constructor of value_type, std::piecewise_construct included
+            template <class... X>
+            explicit node_t(std::in_place_t, X&&... params)
+                : value_type(std::forward<X>(params)...)
             {}
         };
 
@@ -37,17 +45,37 @@ namespace intrhash_map_priv {
         };
 
         using allc_type = nodeallc_t<node_t, A>;
-        using impl_type = intrhash_t<node_t, ops, A>;
+        using impl_type = intrhash_t<node_t, ops, A, P>;
+
+        // key() and mapped() of an extracted entry
+        struct node_handle
+            : public nodeallc_handle_t<node_t, A>
+        {
+            using nodeallc_handle_t<node_t, A>::nodeallc_handle_t;
+
+            const K& key() const noexcept {
+                return this->get()->first;
+            }
+
+            T& mapped() const noexcept {
+                return this->get()->second;
+            }
+        };
     };
 }
 
-template <class K, class T, class O = generic_intrhash_ops, class A = std::allocator<T>>
+template <class K, class T, class O, class A, class P>
+class intrhash_multimap_t;
+
+template <class K, class T, class O = generic_intrhash_ops, class A = std::allocator<T>, class P = generic_intrhash_policy>
 class intrhash_map_t
-    : private intrhash_map_priv::impl<K, T, O, A>::allc_type
-    , private intrhash_map_priv::impl<K, T, O, A>::impl_type
+    : private intrhash_map_priv::impl<K, T, O, A, P>::allc_type
+    , private intrhash_map_priv::impl<K, T, O, A, P>::impl_type
 {
+    template <class, class, class, class, class> friend class intrhash_multimap_t;
+
 private:
-    using priv_impl = typename intrhash_map_priv::impl<K, T, O, A>;
+    using priv_impl = typename intrhash_map_priv::impl<K, T, O, A, P>;
 
     using allc_type = typename priv_impl::allc_type;
     using impl_type = typename priv_impl::impl_type;
@@ -62,6 +90,14 @@ public:
     using iterator = typename impl_type::iterator;
     using const_iterator = typename impl_type::const_iterator;
 
+    using node_handle = typename priv_impl::node_handle;
+
+    struct insert_return_type {
+        iterator position;
+        bool inserted;
+        node_handle node;
+    };
+
 public:
     using allc_type::get_allocator;
 
@@ -75,14 +111,125 @@ public:
     using impl_type::equal_range;
     using impl_type::count;
 
+    using impl_type::find_batch;
+    using impl_type::has_batch;
+    using impl_type::count_batch;
+
     using impl_type::size;
     using impl_type::empty;
 
+    using impl_type::resize;
+    using impl_type::reserve;
+    using impl_type::rehash;
+    using impl_type::shrink_to_fit;
+    using impl_type::bucket_count;
+    using impl_type::load_factor;
+    using impl_type::max_load_factor;
+    using impl_type::min_load_factor;
+
+    using impl_type::stats;
+    using impl_type::bucket_histogram;
+
 public:
     std::pair<iterator, bool> insert(const value_type& value) {
         return this->find_or_push(priv_impl::ops::extract_key(value), [this, &value](){ return this->new_node(value); });
     }
 
+    // hash must be O::hash() of the key
+    std::pair<iterator, bool> insert(const value_type& value, size_t hash) {
+        return this->find_or_push(priv_impl::ops::extract_key(value), hash, [this, &value](){ return this->new_node(value); });
+    }
+
+    std::pair<iterator, bool> insert(value_type&& value) {
+        return this->find_or_push(priv_impl::ops::extract_key(value), [this, &value](){ return this->new_node(std::move(value)); });
+    }
+
+    std::pair<iterator, bool> insert(value_type&& value, size_t hash) {
+        return this->find_or_push(priv_impl::ops::extract_key(value), hash, [this, &value](){ return this->new_node(std::move(value)); });
+    }
+
+    // builds the node before the lookup, as it needs the key; see try_emplace()
+    template <class... X>
+    std::pair<iterator, bool> emplace(X&&... params) {
+        node_type* const node = this->new_node(std::in_place, std::forward<X>(params)...);
+        std::pair<iterator, bool> result;
+
+        try {
+            result = this->find_or_push(priv_impl::ops::extract_key(*node), [node](){ return node; });
+        } catch (...) {
+            this->delete_node(node);
+            throw;
+        }
+
+        if (!result.second) {
+            this->delete_node(node);
+        }
+
+        return result;
+    }
+
+    // constructs the value from params on a miss only
+    template <class... X>
+    std::pair<iterator, bool> try_emplace(const K& key, X&&... params) {
+        return this->find_or_push(key, [this, &key, &params...](){
+            return this->new_node(std::in_place, std::piecewise_construct, std::forward_as_tuple(key), std::forward_as_tuple(std::forward<X>(params)...));
+        });
+    }
+
+    template <class... X>
+    std::pair<iterator, bool> try_emplace(K&& key, X&&... params) {
+        return this->find_or_push(key, [this, &key, &params...](){
+            return this->new_node(std::in_place, std::piecewise_construct, std::forward_as_tuple(std::move(key)), std::forward_as_tuple(std::forward<X>(params)...));
+        });
+    }
+
+    // hash must be O::hash() of the key, which becomes a K on a miss only
+    template <class _K, class... X>
+    std::pair<iterator, bool> try_emplace_hashed(const _K& key, size_t hash, X&&... params) {
+        return this->find_or_push(key, hash, [this, &key, &params...](){
+            return this->new_node(std::in_place, std::piecewise_construct, std::forward_as_tuple(key), std::forward_as_tuple(std::forward<X>(params)...));
+        });
+    }
+
+    template <class M>
+    std::pair<iterator, bool> insert_or_assign(const K& key, M&& value) {
+        const auto result = try_emplace(key, std::forward<M>(value));
+
+        if (!result.second) {
+            result.first->second = std::forward<M>(value);
+        }
+
+        return result;
+    }
+
+    template <class M>
+    std::pair<iterator, bool> insert_or_assign(K&& key, M&& value) {
+        const auto result = try_emplace(std::move(key), std::forward<M>(value));
+
+        if (!result.second) {
+            result.first->second = std::forward<M>(value);
+        }
+
+        return result;
+    }
+
+    template <class I>
+    void insert_range(I first, I last) {
+        if (const size_t n = intrhash_util::range_size(first, last)) {
+            this->reserve(size() + n);
+            this->reserve_nodes(n);
+
+            for (; first != last; ++first) {
+                const value_type& value = *first;
+                this->find_or_push_no_resize(priv_impl::ops::extract_key(value), [this, &value](){ return this->new_node(value); });
+            }
+        } else {
+            for (; first != last; ++first) {
+                insert(*first);
+            }
+        }
+    }
+
     size_t erase(iterator iter) {
         if (node_type *const node = this->pop(iter.node())) {
             this->delete_node(node);
@@ -102,14 +249,113 @@ public:
         }
     }
 
+    template <class _K>
+    size_t erase(const _K& key, size_t hash) {
+        if (node_type* const node = this->pop_one(key, hash)) {
+            this->delete_node(node);
+            return 1;
+        } else {
+            return 0;
+        }
+    }
+
+    // a handle that failed to insert comes back in node; one from another
+    // allocator is moved into a node of this one
+    insert_return_type insert(node_handle&& handle) {
+        if (!handle) {
+            return {end(), false, node_handle()};
+        }
+
+        node_type* const node = this->adopt_node(handle);
+        std::pair<iterator, bool> result;
+
+        try {
+            result = this->find_or_push(priv_impl::ops::extract_key(*node), [node](){ return node; });
+        } catch (...) {
+            handle = this->template make_handle<node_handle>(node);
+            throw;
+        }
+
+        if (!result.second) {
+            return {result.first, false, this->template make_handle<node_handle>(node)};
+        }
+
+        return {result.first, true, node_handle()};
+    }
+
+    node_handle extract(iterator iter) {
+        return this->template make_handle<node_handle>(this->pop(iter.node()));
+    }
+
+    node_handle extract(const_iterator iter) {
+        return this->template make_handle<node_handle>(this->pop(const_cast<node_type*>(iter.node())));
+    }
+
+    template <class _K>
+    node_handle extract(const _K& key) {
+        return this->template make_handle<node_handle>(this->pop_one(key));
+    }
+
+    // relinks the entries of right whose keys are missing here; those stay
+    // in right. Nodes move as they are unless the allocators differ
+    void merge(intrhash_map_t& right) {
+        merge_(right);
+    }
+
+    void merge(intrhash_map_t&& right) {
+        merge_(right);
+    }
+
+    void merge(intrhash_multimap_t<K, T, O, A, P>& right) {
+        merge_(right);
+    }
+
+    void merge(intrhash_multimap_t<K, T, O, A, P>&& right) {
+        merge_(right);
+    }
+
     void clear() {
-        this->decompose([this](node_type* node){ this->delete_node(node); });
+        if constexpr (allc_type::bulk_release) {
+            this->abandon();
+            this->release_nodes();
+        } else {
+            this->decompose([this](node_type* node){ this->delete_node(node); });
+        }
+    }
+
+    // S::save(writer, field) / S::load(reader, field) for the keys and the
+    // values; to and from are a std::ostream / std::istream or a file descriptor
+    template <class S = intrhash_snapshot_raw, class X>
+    void save(X&& to) const {
+        intrhash_snapshot_priv::save(to, size(), sizeof(K), sizeof(T), begin(), end(), [](auto& writer, const value_type& value){
+            S::save(writer, value.first);
+            S::save(writer, value.second);
+        });
+    }
+
+    // replaces the contents; on failure the table holds what was read so far
+    template <class S = intrhash_snapshot_raw, class X>
+    void load(X&& from) {
+        clear();
+        intrhash_snapshot_priv::load(from, sizeof(K), sizeof(T), [this](size_t n){ this->reserve(size() + n); this->reserve_nodes(n); }, [this](auto& reader){
+            K key;
+            T value;
+            S::load(reader, key);
+            S::load(reader, value);
+            this->push_new_no_resize(this->new_node(std::in_place, std::move(key), std::move(value)));
+        });
     }
 
 public:
     template <class _K>
     T& operator[](const _K& key) {
-        return this->find_or_push(key, [this, &key](){ return this->new_node(key); }).first->second;
+        return this->find_or_push(key, [this, &key](){
+            return this->new_node(std::in_place, std::piecewise_construct, std::forward_as_tuple(key), std::forward_as_tuple());
+        }).first->second;
+    }
+
+    T& operator[](K&& key) {
+        return try_emplace(std::move(key)).first->second;
     }
 
 public:
@@ -125,6 +371,11 @@ public:
         , impl_type(n, allc_type::get_allocator())
     {}
 
+    template <class I, class = intrhash_util::enable_if_iterator<I>>
+    intrhash_map_t(I first, I last) {
+        insert_range(first, last);
+    }
+
     intrhash_map_t(intrhash_map_t&& right)
         : allc_type(std::move(right))
         , impl_type(std::move(right))
@@ -154,15 +405,24 @@ public:
         intrhash_map_t(std::move(right)).swap(*this);
         return *this;
     }
+
+private:
+    template <class M>
+    void merge_(M& right) {
+        allc_type& right_allc = right;
+        this->splice(right, true, [this, &right_allc](node_type* node){ return this->adopt_node(node, right_allc); }, [&right_allc](node_type* node){ right_allc.delete_node(node); });
+    }
 };
 
-template <class K, class T, class O = generic_intrhash_ops, class A = std::allocator<T>>
+template <class K, class T, class O = generic_intrhash_ops, class A = std::allocator<T>, class P = generic_intrhash_policy>
 class intrhash_multimap_t
-    : private intrhash_map_priv::impl<K, T, O, A>::allc_type
-    , private intrhash_map_priv::impl<K, T, O, A>::impl_type
+    : private intrhash_map_priv::impl<K, T, O, A, P>::allc_type
+    , private intrhash_map_priv::impl<K, T, O, A, P>::impl_type
 {
+    template <class, class, class, class, class> friend class intrhash_map_t;
+
 private:
-    using priv_impl = typename intrhash_map_priv::impl<K, T, O, A>;
+    using priv_impl = typename intrhash_map_priv::impl<K, T, O, A, P>;
 
     using allc_type = typename priv_impl::allc_type;
     using impl_type = typename priv_impl::impl_type;
@@ -177,6 +437,8 @@ public:
     using iterator = typename impl_type::iterator;
     using const_iterator = typename impl_type::const_iterator;
 
+    using node_handle = typename priv_impl::node_handle;
+
 public:
     using allc_type::get_allocator;
 
@@ -190,17 +452,74 @@ public:
     using impl_type::equal_range;
     using impl_type::count;
 
+    using impl_type::find_batch;
+    using impl_type::has_batch;
+    using impl_type::count_batch;
+
     using impl_type::size;
     using impl_type::empty;
 
+    using impl_type::resize;
+    using impl_type::reserve;
+    using impl_type::rehash;
+    using impl_type::shrink_to_fit;
+    using impl_type::bucket_count;
+    using impl_type::load_factor;
+    using impl_type::max_load_factor;
+    using impl_type::min_load_factor;
+
+    using impl_type::stats;
+    using impl_type::bucket_histogram;
+
 public:
     iterator insert(const value_type& value) {
         return {this->push(this->new_node(value))};
     }
 
+    iterator insert(const value_type& value, size_t hash) {
+        return {this->push(this->new_node(value), hash)};
+    }
+
+    iterator insert(value_type&& value) {
+        return {this->push(this->new_node(std::move(value)))};
+    }
+
+    iterator insert(value_type&& value, size_t hash) {
+        return {this->push(this->new_node(std::move(value)), hash)};
+    }
+
+    template <class... X>
+    iterator emplace(X&&... params) {
+        node_type* const node = this->new_node(std::in_place, std::forward<X>(params)...);
+
+        try {
+            return {this->push(node)};
+        } catch (...) {
+            this->delete_node(node);
+            throw;
+        }
+    }
+
+    template <class I>
+    void insert_range(I first, I last) {
+        if (const size_t n = intrhash_util::range_size(first, last)) {
+            this->reserve(size() + n);
+            this->reserve_nodes(n);
+
+            for (; first != last; ++first) {
+                const value_type& value = *first;
+                this->push_no_resize(this->new_node(value));
+            }
+        } else {
+            for (; first != last; ++first) {
+                insert(*first);
+            }
+        }
+    }
+
     size_t erase(iterator iter) {
-        if (node_type *const node = pop(iter.node())) {
-            delete_node(node);
+        if (node_type *const node = this->pop(iter.node())) {
+            this->delete_node(node);
             return 1;
         } else {
             return 0;
@@ -214,8 +533,90 @@ public:
         return result;
     }
 
+    template <class _K>
+    size_t erase(const _K& key, size_t hash) {
+        size_t result = 0;
+        this->pop_all(key, hash, [this, &result](node_type* node){ this->delete_node(node); ++result; });
+        return result;
+    }
+
+    // a handle from another allocator is moved into a node of this one
+    iterator insert(node_handle&& handle) {
+        if (!handle) {
+            return end();
+        }
+
+        node_type* const node = this->adopt_node(handle);
+
+        try {
+            return {this->push(node)};
+        } catch (...) {
+            handle = this->template make_handle<node_handle>(node);
+            throw;
+        }
+    }
+
+    node_handle extract(iterator iter) {
+        return this->template make_handle<node_handle>(this->pop(iter.node()));
+    }
+
+    node_handle extract(const_iterator iter) {
+        return this->template make_handle<node_handle>(this->pop(const_cast<node_type*>(iter.node())));
+    }
+
+    template <class _K>
+    node_handle extract(const _K& key) {
+        return this->template make_handle<node_handle>(this->pop_one(key));
+    }
+
+    // relinks every entry of right here; nodes move as they are unless the
+    // allocators differ
+    void merge(intrhash_multimap_t& right) {
+        merge_(right);
+    }
+
+    void merge(intrhash_multimap_t&& right) {
+        merge_(right);
+    }
+
+    void merge(intrhash_map_t<K, T, O, A, P>& right) {
+        merge_(right);
+    }
+
+    void merge(intrhash_map_t<K, T, O, A, P>&& right) {
+        merge_(right);
+    }
+
     void clear() {
-        this->decompose([this](node_type* node){ this->delete_node(node); });
+        if constexpr (allc_type::bulk_release) {
+            this->abandon();
+            this->release_nodes();
+        } else {
+            this->decompose([this](node_type* node){ this->delete_node(node); });
+        }
+    }
+
+    // S::save(writer, field) / S::load(reader, field) for the keys and the
+    // values; to and from are a std::ostream / std::istream or a file descriptor
+    template <class S = intrhash_snapshot_raw, class X>
+    void save(X&& to) const {
+        intrhash_snapshot_priv::save(to, size(), sizeof(K), sizeof(T), begin(), end(), [](auto& writer, const value_type& value){
+            S::save(writer, value.first);
+            S::save(writer, value.second);
+        });
+    }
+
+    // replaces the contents; on failure the table holds what was read so far
+    template <class S = intrhash_snapshot_raw, class X>
+    void load(X&& from) {
+        clear();
+        intrhash_snapshot_priv::load(from, sizeof(K), sizeof(T), [this](size_t n){ this->reserve(size() + n); this->reserve_nodes(n); }, [this](auto& reader){
+            K key;
+            T value;
+            S::load(reader, key);
+            S::load(reader, value);
+            this->push_new_no_resize(this->new_node(std::in_place, std::move(key), std::move(value)));
+        });
     }
 
 public:
@@ -231,6 +632,11 @@ public:
         , impl_type(n, allc_type::get_allocator())
     {}
 
+    template <class I, class = intrhash_util::enable_if_iterator<I>>
+    intrhash_multimap_t(I first, I last) {
+        insert_range(first, last);
+    }
+
     intrhash_multimap_t(intrhash_multimap_t&& right) noexcept
         : allc_type(std::move(right))
         , impl_type(std::move(right))
@@ -260,4 +666,11 @@ public:
         intrhash_multimap_t(std::move(right)).swap(*this);
         return *this;
     }
+
+private:
+    template <class M>
+    void merge_(M& right) {
+        allc_type& right_allc = right;
+        this->splice(right, false, [this, &right_allc](node_type* node){ return this->adopt_node(node, right_allc); }, [&right_allc](node_type* node){ right_allc.delete_node(node); });
+    }
 };
@@ -2,20 +2,30 @@
 
 #include "intrhash.h"
 #include "nodeallc.h"
+#include "snapshot.h"
 
 namespace intrhash_set_priv {
-    template <class T, class O, class A>
+    template <class T, class O, class A, class P>
     struct impl {
         using value_type = T;
 
         struct node_t
-            : public intrhash_item_t<node_t>
+            : public P::template item<node_t>
         {
             node_t(const value_type& value)
                 : value_(value)
             {}
 
-            const value_type value_;
+            node_t(value_type&& value)
+                : value_(std::move(value))
+            {}
+
+            template <class... X>
+            explicit node_t(std::in_place_t, X&&... params)
+                : value_(std::forward<X>(params)...)
+            {}
+
+            value_type value_;
         };
 
         struct ops
@@ -35,17 +45,32 @@ namespace intrhash_set_priv {
         };
 
         using allc_type = nodeallc_t<node_t, A>;
-        using impl_type = intrhash_t<node_t, opts_t, A>;
+        using impl_type = intrhash_t<node_t, ops, A, P>;
+
+        struct node_handle
+            : public nodeallc_handle_t<node_t, A>
+        {
+            using nodeallc_handle_t<node_t, A>::nodeallc_handle_t;
+
+            value_type& value() const noexcept {
+                return this->get()->value_;
+            }
+        };
     };
 }
 
-template <class T, class O = generic_intrhash_ops, class A = std::allocator<T>>
+template <class T, class O, class A, class P>
+class intrhash_multiset_t;
+
+template <class T, class O = generic_intrhash_ops, class A = std::allocator<T>, class P = generic_intrhash_policy>
 class intrhash_set_t
-    : private intrhash_set_priv::impl<T, O, A>::allc_type
-    , private intrhash_set_priv::impl<T, O, A>::impl_type
+    : private intrhash_set_priv::impl<T, O, A, P>::allc_type
+    , private intrhash_set_priv::impl<T, O, A, P>::impl_type
 {
+    template <class, class, class, class> friend class intrhash_multiset_t;
+
 private:
-    using priv_impl = typename intrhash_set_priv::impl<T, O, A>;
+    using priv_impl = typename intrhash_set_priv::impl<T, O, A, P>;
 
     using allc_type = typename priv_impl::allc_type;
     using impl_type = typename priv_impl::impl_type;
@@ -60,6 +85,14 @@ public:
     using iterator = typename impl_type::iterator;
     using const_iterator = typename impl_type::const_iterator;
 
+    using node_handle = typename priv_impl::node_handle;
+
+    struct insert_return_type {
+        iterator position;
+        bool inserted;
+        node_handle node;
+    };
+
 public:
     using allc_type::get_allocator;
 
@@ -73,16 +106,82 @@ public:
     using impl_type::equal_range;
     using impl_type::count;
 
+    using impl_type::find_batch;
+    using impl_type::has_batch;
+    using impl_type::count_batch;
+
     using impl_type::size;
     using impl_type::empty;
 
+    using impl_type::resize;
+    using impl_type::reserve;
+    using impl_type::rehash;
+    using impl_type::shrink_to_fit;
+    using impl_type::bucket_count;
+    using impl_type::load_factor;
+    using impl_type::max_load_factor;
+    using impl_type::min_load_factor;
+
+    using impl_type::stats;
+    using impl_type::bucket_histogram;
+
 public:
     std::pair<iterator, bool> insert(const value_type& value) {
         return this->find_or_push(value, [this, &value](){ return this->new_node(value); });
     }
 
+    // hash must be O::hash() of the key
+    std::pair<iterator, bool> insert(const value_type& value, size_t hash) {
+        return this->find_or_push(value, hash, [this, &value](){ return this->new_node(value); });
+    }
+
+    std::pair<iterator, bool> insert(value_type&& value) {
+        return this->find_or_push(value, [this, &value](){ return this->new_node(std::move(value)); });
+    }
+
+    std::pair<iterator, bool> insert(value_type&& value, size_t hash) {
+        return this->find_or_push(value, hash, [this, &value](){ return this->new_node(std::move(value)); });
+    }
+
+    // builds the node before the lookup, as the value is the key
+    template <class... X>
+    std::pair<iterator, bool> emplace(X&&... params) {
+        node_type* const node = this->new_node(std::in_place, std::forward<X>(params)...);
+        std::pair<iterator, bool> result;
+
+        try {
+            result = this->find_or_push(priv_impl::ops::extract_key(*node), [node](){ return node; });
+        } catch (...) {
+            this->delete_node(node);
+            throw;
+        }
+
+        if (!result.second) {
+            this->delete_node(node);
+        }
+
+        return result;
+    }
+
+    template <class I>
+    void insert_range(I first, I last) {
+        if (const size_t n = intrhash_util::range_size(first, last)) {
+            this->reserve(size() + n);
+            this->reserve_nodes(n);
+
+            for (; first != last; ++first) {
+                const value_type& value = *first;
+                this->find_or_push_no_resize(value, [this, &value](){ return this->new_node(value); });
+            }
+        } else {
+            for (; first != last; ++first) {
+                insert(*first);
+            }
+        }
+    }
+
     size_t erase(iterator iter) {
-        if (node_type *const node = pop(iter.node())) {
+        if (node_type *const node = this->pop(iter.node())) {
             this->delete_node(node);
             return 1;
         } else {
@@ -100,8 +199,98 @@ public:
         }
     }
 
+    template <class K>
+    size_t erase(const K& key, size_t hash) {
+        if (node_type* const node = this->pop_one(key, hash)) {
+            this->delete_node(node);
+            return 1;
+        } else {
+            return 0;
+        }
+    }
+
+    // a handle that failed to insert comes back in node; one from another
+    // allocator is moved into a node of this one
+    insert_return_type insert(node_handle&& handle) {
+        if (!handle) {
+            return {end(), false, node_handle()};
+        }
+
+        node_type* const node = this->adopt_node(handle);
+        std::pair<iterator, bool> result;
+
+        try {
+            result = this->find_or_push(priv_impl::ops::extract_key(*node), [node](){ return node; });
+        } catch (...) {
+            handle = this->template make_handle<node_handle>(node);
+            throw;
+        }
+
+        if (!result.second) {
+            return {result.first, false, this->template make_handle<node_handle>(node)};
+        }
+
+        return {result.first, true, node_handle()};
+    }
+
+    node_handle extract(iterator iter) {
+        return this->template make_handle<node_handle>(this->pop(iter.node()));
+    }
+
+    node_handle extract(const_iterator iter) {
+        return this->template make_handle<node_handle>(this->pop(const_cast<node_type*>(iter.node())));
+    }
+
+    template <class K>
+    node_handle extract(const K& key) {
+        return this->template make_handle<node_handle>(this->pop_one(key));
+    }
+
+    // relinks the entries of right whose keys are missing here; those stay
+    // in right. Nodes move as they are unless the allocators differ
+    void merge(intrhash_set_t& right) {
+        merge_(right);
+    }
+
+    void merge(intrhash_set_t&& right) {
+        merge_(right);
+    }
+
+    void merge(intrhash_multiset_t<T, O, A, P>& right) {
+        merge_(right);
+    }
+
+    void merge(intrhash_multiset_t<T, O, A, P>&& right) {
+        merge_(right);
+    }
+
     void clear() {
-        this->decompose([this](node_type* node){ this->delete_node(node); });
+        if constexpr (allc_type::bulk_release) {
+            this->abandon();
+            this->release_nodes();
+        } else {
+            this->decompose([this](node_type* node){ this->delete_node(node); });
+        }
+    }
+
+    // S::save(writer, value) / S::load(reader, value) for the values; to and
+    // from are a std::ostream / std::istream or a file descriptor
+    template <class S = intrhash_snapshot_raw, class X>
+    void save(X&& to) const {
+        intrhash_snapshot_priv::save(to, size(), sizeof(T), 0, begin(), end(), [](auto& writer, const value_type& value){
+            S::save(writer, value);
+        });
+    }
+
+    // replaces the contents; on failure the table holds what was read so far
+    template <class S = intrhash_snapshot_raw, class X>
+    void load(X&& from) {
+        clear();
+        intrhash_snapshot_priv::load(from, sizeof(T), 0, [this](size_t n){ this->reserve(size() + n); this->reserve_nodes(n); }, [this](auto& reader){
+            T value;
+            S::load(reader, value);
+            this->push_new_no_resize(this->new_node(std::move(value)));
+        });
     }
 
 public:
@@ -117,6 +306,11 @@ public:
         , impl_type(n, allc_type::get_allocator())
     {}
 
+    template <class I, class = intrhash_util::enable_if_iterator<I>>
+    intrhash_set_t(I first, I last) {
+        insert_range(first, last);
+    }
+
     intrhash_set_t(intrhash_set_t&& right)
         : allc_type(std::move(right))
         , impl_type(std::move(right))
@@ -146,15 +340,24 @@ public:
         intrhash_set_t(std::move(right)).swap(*this);
         return *this;
     }
+
+private:
+    template <class M>
+    void merge_(M& right) {
+        allc_type& right_allc = right;
+        this->splice(right, true, [this, &right_allc](node_type* node){ return this->adopt_node(node, right_allc); }, [&right_allc](node_type* node){ right_allc.delete_node(node); });
+    }
 };
 
-template <class T, class O = common_intrhash_ops, class A = std::allocator<T>>
+template <class T, class O = generic_intrhash_ops, class A = std::allocator<T>, class P = generic_intrhash_policy>
 class intrhash_multiset_t
-    : private intrhash_set_priv::impl<T, O, A>::allc_type
-    , private intrhash_set_priv::impl<T, O, A>::impl_type
+    : private intrhash_set_priv::impl<T, O, A, P>::allc_type
+    , private intrhash_set_priv::impl<T, O, A, P>::impl_type
 {
+    template <class, class, class, class> friend class intrhash_set_t;
+
 private:
-    using priv_impl = typename intrhash_set_priv::impl<T, O, A>;
+    using priv_impl = typename intrhash_set_priv::impl<T, O, A, P>;
 
     using allc_type = typename priv_impl::allc_type;
     using impl_type = typename priv_impl::impl_type;
@@ -169,6 +372,8 @@ public:
     using iterator = typename impl_type::iterator;
     using const_iterator = typename impl_type::const_iterator;
 
+    using node_handle = typename priv_impl::node_handle;
+
 public:
     using allc_type::get_allocator;
 
@@ -182,16 +387,73 @@ public:
     using impl_type::equal_range;
     using impl_type::count;
 
+    using impl_type::find_batch;
+    using impl_type::has_batch;
+    using impl_type::count_batch;
+
     using impl_type::size;
     using impl_type::empty;
 
+    using impl_type::resize;
+    using impl_type::reserve;
+    using impl_type::rehash;
+    using impl_type::shrink_to_fit;
+    using impl_type::bucket_count;
+    using impl_type::load_factor;
+    using impl_type::max_load_factor;
+    using impl_type::min_load_factor;
+
+    using impl_type::stats;
+    using impl_type::bucket_histogram;
+
 public:
     iterator insert(const value_type& value) {
         return this->push(this->new_node(value));
     }
 
+    iterator insert(const value_type& value, size_t hash) {
+        return this->push(this->new_node(value), hash);
+    }
+
+    iterator insert(value_type&& value) {
+        return this->push(this->new_node(std::move(value)));
+    }
+
+    iterator insert(value_type&& value, size_t hash) {
+        return this->push(this->new_node(std::move(value)), hash);
+    }
+
+    template <class... X>
+    iterator emplace(X&&... params) {
+        node_type* const node = this->new_node(std::in_place, std::forward<X>(params)...);
+
+        try {
+            return this->push(node);
+        } catch (...) {
+            this->delete_node(node);
+            throw;
+        }
+    }
+
+    template <class I>
+    void insert_range(I first, I last) {
+        if (const size_t n = intrhash_util::range_size(first, last)) {
+            this->reserve(size() + n);
+            this->reserve_nodes(n);
+
+            for (; first != last; ++first) {
+                const value_type& value = *first;
+                this->push_no_resize(this->new_node(value));
+            }
+        } else {
+            for (; first != last; ++first) {
+                insert(*first);
+            }
+        }
+    }
+
     size_t erase(iterator iter) {
-        if (node_type *const node = pop(iter.node())) {
+        if (node_type *const node = this->pop(iter.node())) {
             this->delete_node(node);
             return 1;
         } else {
@@ -206,8 +468,87 @@ public:
         return result;
     }
 
+    template <class K>
+    size_t erase(const K& key, size_t hash) {
+        size_t result = 0;
+        this->pop_all(key, hash, [this, &result](node_type* node){ this->delete_node(node); ++result; });
+        return result;
+    }
+
+    // a handle from another allocator is moved into a node of this one
+    iterator insert(node_handle&& handle) {
+        if (!handle) {
+            return end();
+        }
+
+        node_type* const node = this->adopt_node(handle);
+
+        try {
+            return {this->push(node)};
+        } catch (...) {
+            handle = this->template make_handle<node_handle>(node);
+            throw;
+        }
+    }
+
+    node_handle extract(iterator iter) {
+        return this->template make_handle<node_handle>(this->pop(iter.node()));
+    }
+
+    node_handle extract(const_iterator iter) {
+        return this->template make_handle<node_handle>(this->pop(const_cast<node_type*>(iter.node())));
+    }
+
+    template <class K>
+    node_handle extract(const K& key) {
+        return this->template make_handle<node_handle>(this->pop_one(key));
+    }
+
+    // relinks every entry of right here; nodes move as they are unless the
+    // allocators differ
+    void merge(intrhash_multiset_t& right) {
+        merge_(right);
+    }
+
+    void merge(intrhash_multiset_t&& right) {
+        merge_(right);
+    }
+
+    void merge(intrhash_set_t<T, O, A, P>& right) {
+        merge_(right);
+    }
+
+    void merge(intrhash_set_t<T, O, A, P>&& right) {
+        merge_(right);
+    }
+
     void clear() {
-        this->decompose([this](node_type* node){ this->delete_node(node); });
+        if constexpr (allc_type::bulk_release) {
+            this->abandon();
+            this->release_nodes();
+        } else {
+            this->decompose([this](node_type* node){ this->delete_node(node); });
+        }
+    }
+
+    // S::save(writer, value) / S::load(reader, value) for the values; to and
+    // from are a std::ostream / std::istream or a file descriptor
+    template <class S = intrhash_snapshot_raw, class X>
+    void save(X&& to) const {
+        intrhash_snapshot_priv::save(to, size(), sizeof(T), 0, begin(), end(), [](auto& writer, const value_type& value){
+            S::save(writer, value);
+        });
+    }
+
+    // replaces the contents; on failure the table holds what was read so far
+    template <class S = intrhash_snapshot_raw, class X>
+    void load(X&& from) {
+        clear();
+        intrhash_snapshot_priv::load(from, sizeof(T), 0, [this](size_t n){ this->reserve(size() + n); this->reserve_nodes(n); }, [this](auto& reader){
+            T value;
+            S::load(reader, value);
+            this->push_new_no_resize(this->new_node(std::move(value)));
+        });
     }
 
 public:
@@ -227,6 +568,11 @@ public:
         , impl_type(n, allc_type::get_allocator())
     {}
 
+    template <class I, class = intrhash_util::enable_if_iterator<I>>
+    intrhash_multiset_t(I first, I last) {
+        insert_range(first, last);
+    }
+
     intrhash_multiset_t(intrhash_multiset_t&& right) noexcept
         : allc_type(std::move(right))
         , impl_type(std::move(right))
@@ -256,4 +602,11 @@ public:
         intrhash_multiset_t(std::move(right)).swap(*this);
         return *this;
     }
+
+private:
+    template <class M>
+    void merge_(M& right) {
+        allc_type& right_allc = right;
+        this->splice(right, false, [this, &right_allc](node_type* node){ return this->adopt_node(node, right_allc); }, [&right_allc](node_type* node){ right_allc.delete_node(node); });
+    }
 };
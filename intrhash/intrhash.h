@@ -1,10 +1,16 @@
 #pragma once
 
 #include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <exception>
 #include <functional>
+#include <iterator>
 #include <memory>
 #include <type_traits>
 #include <utility>
+#include <vector>
 
 namespace intrhash_util {
     template <class T> T declret() noexcept;
@@ -24,6 +30,43 @@ namespace intrhash_util {
     template <bool X, class T1, class T2>
     using select_type = typename select_type_priv::select_type_impl<X, T1, T2>::result_type;
 
+    // address bits above bit 48 that a pointer to an item may lend to a hash
+    // fingerprint; AArch64 keeps its top byte for memory tagging
+#if defined(__x86_64__) || defined(_M_X64)
+    constexpr unsigned pointer_tag_bits = 16;
+#elif defined(__aarch64__) || defined(_M_ARM64)
+    constexpr unsigned pointer_tag_bits = 8;
+#else
+    constexpr unsigned pointer_tag_bits = 0;
+#endif
+
+    inline void prefetch(const void* ptr) noexcept {
+#if defined(__GNUC__)
+        __builtin_prefetch(ptr);
+#else
+        (void)ptr;
+#endif
+    }
+
+    // number of elements in a range that can be walked twice, 0 otherwise
+    template <class I>
+    size_t range_size(I, I, std::input_iterator_tag) noexcept {
+        return 0;
+    }
+
+    template <class I>
+    size_t range_size(I first, I last, std::forward_iterator_tag) {
+        return std::distance(first, last);
+    }
+
+    template <class I>
+    size_t range_size(I first, I last) {
+        return range_size(first, last, typename std::iterator_traits<I>::iterator_category());
+    }
+
+    template <class I>
+    using enable_if_iterator = typename std::iterator_traits<I>::iterator_category;
+
     struct delete_ops {
         template <class T>
         static void destroy(T* t) noexcept {
@@ -37,27 +80,112 @@ namespace intrhash_util {
 }
 
 namespace intrhash_priv {
-    static size_t buckets_count(size_t n) noexcept {
-        static const size_t primes[] = {
-            7ul, 17ul, 29ul, 53ul, 97ul,
-            193ul, 389ul, 769ul, 1543ul, 3079ul,
-            6151ul, 12289ul, 24593ul, 49157ul, 98317ul,
-            196613ul, 393241ul, 786433ul, 1572869ul, 3145739ul,
-            6291469ul, 12582917ul, 25165843ul, 50331653ul, 100663319ul,
-            201326611ul, 402653189ul, 805306457ul, 1610612741ul, 3221225473ul, 4294967291ul,
-        };
+    constexpr size_t primes[] = {
+        7ul, 17ul, 29ul, 53ul, 97ul,
+        193ul, 389ul, 769ul, 1543ul, 3079ul,
+        6151ul, 12289ul, 24593ul, 49157ul, 98317ul,
+        196613ul, 393241ul, 786433ul, 1572869ul, 3145739ul,
+        6291469ul, 12582917ul, 25165843ul, 50331653ul, 100663319ul,
+        201326611ul, 402653189ul, 805306457ul, 1610612741ul, 3221225473ul, 4294967291ul,
+    };
 
-        static const size_t* const first_prime = primes;
-        static const size_t* const last_prime = first_prime + sizeof(primes) / sizeof(*primes) - 1;
+    inline size_t prime_index(size_t n) noexcept {
+        const size_t* const first_prime = primes;
+        const size_t* const last_prime = first_prime + sizeof(primes) / sizeof(*primes) - 1;
 
         if (n <= *first_prime) {
-            return *first_prime;
+            return 0;
         } else {
-            return *std::lower_bound(first_prime, last_prime, n);
+            return std::lower_bound(first_prime, last_prime, n) - first_prime;
         }
     }
+
+    inline size_t buckets_count(size_t n) noexcept {
+        return primes[prime_index(n)];
+    }
 }
 
+class prime_intrhash_buckets {
+public:
+    prime_intrhash_buckets() = default;
+
+    explicit prime_intrhash_buckets(size_t n) noexcept
+        : prime_(intrhash_priv::prime_index(n))
+    {}
+
+    size_t size() const noexcept {
+        return intrhash_priv::primes[prime_];
+    }
+
+    // constant divisors let the compiler replace the division with a multiply
+    size_t index(size_t hash) const noexcept {
+        switch (prime_) {
+            case 0: return hash % intrhash_priv::primes[0];
+            case 1: return hash % intrhash_priv::primes[1];
+            case 2: return hash % intrhash_priv::primes[2];
+            case 3: return hash % intrhash_priv::primes[3];
+            case 4: return hash % intrhash_priv::primes[4];
+            case 5: return hash % intrhash_priv::primes[5];
+            case 6: return hash % intrhash_priv::primes[6];
+            case 7: return hash % intrhash_priv::primes[7];
+            case 8: return hash % intrhash_priv::primes[8];
+            case 9: return hash % intrhash_priv::primes[9];
+            case 10: return hash % intrhash_priv::primes[10];
+            case 11: return hash % intrhash_priv::primes[11];
+            case 12: return hash % intrhash_priv::primes[12];
+            case 13: return hash % intrhash_priv::primes[13];
+            case 14: return hash % intrhash_priv::primes[14];
+            case 15: return hash % intrhash_priv::primes[15];
+            case 16: return hash % intrhash_priv::primes[16];
+            case 17: return hash % intrhash_priv::primes[17];
+            case 18: return hash % intrhash_priv::primes[18];
+            case 19: return hash % intrhash_priv::primes[19];
+            case 20: return hash % intrhash_priv::primes[20];
+            case 21: return hash % intrhash_priv::primes[21];
+            case 22: return hash % intrhash_priv::primes[22];
+            case 23: return hash % intrhash_priv::primes[23];
+            case 24: return hash % intrhash_priv::primes[24];
+            case 25: return hash % intrhash_priv::primes[25];
+            case 26: return hash % intrhash_priv::primes[26];
+            case 27: return hash % intrhash_priv::primes[27];
+            case 28: return hash % intrhash_priv::primes[28];
+            case 29: return hash % intrhash_priv::primes[29];
+            default: return hash % intrhash_priv::primes[30];
+        }
+    }
+
+private:
+    static_assert(sizeof(intrhash_priv::primes) / sizeof(*intrhash_priv::primes) == 31, "index() must have a case per prime");
+
+    size_t prime_ = 0;
+};
+
+class pow2_intrhash_buckets {
+public:
+    pow2_intrhash_buckets() = default;
+
+    explicit pow2_intrhash_buckets(size_t n) noexcept {
+        while (shift_ > min_shift_ && (size_t(1) << (bits_ - shift_)) < n) {
+            --shift_;
+        }
+    }
+
+    size_t size() const noexcept {
+        return size_t(1) << (bits_ - shift_);
+    }
+
+    // fibonacci hashing: the top bits of the product depend on every bit of the hash
+    size_t index(size_t hash) const noexcept {
+        return static_cast<size_t>(static_cast<uint64_t>(hash) * 0x9e3779b97f4a7c15ull >> shift_);
+    }
+
+private:
+    static constexpr unsigned bits_ = 64;
+    static constexpr unsigned min_shift_ = bits_ - sizeof(size_t) * 8 + 1;
+
+    unsigned shift_ = bits_ - 3;
+};
+
 namespace oneshot_vector {
     template <class T, class V>
     class vector_ops {
@@ -116,7 +244,7 @@ namespace oneshot_vector {
 
     template <class T, class A = std::allocator<T>>
     class oneshot_vector_t
-        : public vector_ops<T, oneshot_vector_t<T>>
+        : public vector_ops<T, oneshot_vector_t<T, A>>
     {
     private:
         using value_type = T;
@@ -206,7 +334,7 @@ namespace oneshot_vector {
 
 template <class T>
 class intrhash_item_t {
-    template <class, class, class> friend class intrhash_t;
+    template <class, class, class, class> friend class intrhash_t;
 
 public:
     bool linked() const noexcept {
@@ -245,10 +373,175 @@ private:
         next_ = _next;
     }
 
+    static constexpr bool cached_hash = false;
+    static constexpr bool ordered = false;
+
+    template <class O>
+    size_t hash() const {
+        return O::hash(O::extract_key(*node()));
+    }
+
+    void set_hash(size_t) noexcept {
+    }
+
+private:
+    item_type* next_ = nullptr;
+};
+
+template <class T>
+class intrhash_hashed_item_t {
+    template <class, class, class, class> friend class intrhash_t;
+
+public:
+    bool linked() const noexcept {
+        return next_;
+    }
+
+private:
+    using node_type = T;
+    using item_type = intrhash_hashed_item_t<node_type>;
+
+    node_type* node() noexcept {
+        return static_cast<node_type*>(this);
+    }
+
+    const node_type* node() const noexcept {
+        return static_cast<const node_type*>(this);
+    }
+
+    item_type* next() noexcept {
+        return next_;
+    }
+
+    const item_type* next() const noexcept {
+        return next_;
+    }
+
+    item_type** next_ptr() noexcept {
+        return &next_;
+    }
+
+    const item_type* const* next_ptr() const noexcept {
+        return &next_;
+    }
+
+    void set_next(item_type* _next) noexcept {
+        next_ = _next;
+    }
+
+    static constexpr bool cached_hash = true;
+    static constexpr bool ordered = false;
+
+    template <class O>
+    size_t hash() const noexcept {
+        return hash_;
+    }
+
+    void set_hash(size_t _hash) noexcept {
+        hash_ = _hash;
+    }
+
+private:
+    item_type* next_ = nullptr;
+    size_t hash_ = 0;
+};
+
+// also links every item into one list in insertion order, which iteration and
+// decompose() follow instead of scanning the buckets
+template <class T>
+class intrhash_linked_item_t {
+    template <class, class, class, class> friend class intrhash_t;
+
+public:
+    bool linked() const noexcept {
+        return next_;
+    }
+
+private:
+    using node_type = T;
+    using item_type = intrhash_linked_item_t<node_type>;
+
+    node_type* node() noexcept {
+        return static_cast<node_type*>(this);
+    }
+
+    const node_type* node() const noexcept {
+        return static_cast<const node_type*>(this);
+    }
+
+    item_type* next() noexcept {
+        return next_;
+    }
+
+    const item_type* next() const noexcept {
+        return next_;
+    }
+
+    item_type** next_ptr() noexcept {
+        return &next_;
+    }
+
+    const item_type* const* next_ptr() const noexcept {
+        return &next_;
+    }
+
+    void set_next(item_type* _next) noexcept {
+        next_ = _next;
+    }
+
+    item_type* before() const noexcept {
+        return before_;
+    }
+
+    item_type* after() const noexcept {
+        return after_;
+    }
+
+    void set_before(item_type* _before) noexcept {
+        before_ = _before;
+    }
+
+    void set_after(item_type* _after) noexcept {
+        after_ = _after;
+    }
+
+    static constexpr bool cached_hash = false;
+    static constexpr bool ordered = true;
+
+    template <class O>
+    size_t hash() const {
+        return O::hash(O::extract_key(*node()));
+    }
+
+    void set_hash(size_t) noexcept {
+    }
+
 private:
     item_type* next_ = nullptr;
+    item_type* before_ = nullptr;
+    item_type* after_ = nullptr;
 };
 
+namespace intrhash_priv {
+    // ends of the insertion order list, for items that keep one
+    template <class I, bool X = I::ordered>
+    struct order_list_t {
+        void swap(order_list_t&) noexcept {
+        }
+    };
+
+    template <class I>
+    struct order_list_t<I, true> {
+        void swap(order_list_t& right) noexcept {
+            std::swap(head, right.head);
+            std::swap(tail, right.tail);
+        }
+
+        I* head = nullptr;
+        I* tail = nullptr;
+    };
+}
+
 struct generic_intrhash_ops {
     template <class K>
     static size_t hash(const K& key) {
@@ -266,10 +559,290 @@ struct generic_intrhash_ops {
     }
 };
 
-template <class T, class O, class A = std::allocator<T>>
-class intrhash_t {
+struct intrhash_nostats {
+    void on_lookup(size_t, bool) const noexcept {
+    }
+
+    int on_resize_begin() const noexcept {
+        return 0;
+    }
+
+    void on_resize_end(int) noexcept {
+    }
+};
+
+// counters are plain integers: a table is not thread safe anyway; resize time
+// covers whole rehashes and the start of incremental ones, not migration steps
+class intrhash_stats {
+public:
+    using clock_type = std::chrono::steady_clock;
+
+    void on_lookup(size_t steps, bool hit) const noexcept {
+        ++lookups_;
+        hits_ += hit;
+        steps_ += steps;
+    }
+
+    clock_type::time_point on_resize_begin() const noexcept {
+        return clock_type::now();
+    }
+
+    void on_resize_end(clock_type::time_point start) noexcept {
+        ++resizes_;
+        resize_time_ += clock_type::now() - start;
+    }
+
+public:
+    size_t lookups() const noexcept {
+        return lookups_;
+    }
+
+    size_t hits() const noexcept {
+        return hits_;
+    }
+
+    size_t misses() const noexcept {
+        return lookups_ - hits_;
+    }
+
+    // chain entries compared, summed over all lookups
+    size_t chain_steps() const noexcept {
+        return steps_;
+    }
+
+    double mean_chain_steps() const noexcept {
+        return lookups_ ? static_cast<double>(steps_) / lookups_ : 0;
+    }
+
+    size_t resizes() const noexcept {
+        return resizes_;
+    }
+
+    clock_type::duration resize_time() const noexcept {
+        return resize_time_;
+    }
+
+    void reset() noexcept {
+        *this = intrhash_stats();
+    }
+
+    template <class S>
+    friend S& operator<<(S& out, const intrhash_stats& stats) {
+        out << "lookups=" << stats.lookups()
+            << " hits=" << stats.hits()
+            << " misses=" << stats.misses()
+            << " chain_steps=" << stats.chain_steps()
+            << " resizes=" << stats.resizes()
+            << " resize_ns=" << std::chrono::duration_cast<std::chrono::nanoseconds>(stats.resize_time()).count();
+        return out;
+    }
+
+private:
+    mutable size_t lookups_ = 0;
+    mutable size_t hits_ = 0;
+    mutable size_t steps_ = 0;
+    size_t resizes_ = 0;
+    clock_type::duration resize_time_ = clock_type::duration::zero();
+};
+
+// keeps no filter: every lookup walks its chain
+struct intrhash_nofilter {
+    intrhash_nofilter() = default;
+
+    explicit intrhash_nofilter(size_t) noexcept {
+    }
+
+    void add(size_t) noexcept {
+    }
+
+    bool may_contain(size_t) const noexcept {
+        return true;
+    }
+
+    void prefetch(size_t) const noexcept {
+    }
+
+    bool stale(size_t) const noexcept {
+        return false;
+    }
+
+    void swap(intrhash_nofilter&) noexcept {
+    }
+};
+
+// Split block Bloom filter of B bits per key: a key sets one bit in each word
+// of one 64 byte block, so ruling a key out reads a single cache line. Erased
+// keys keep their bits; stale() asks the table for a rebuild once they are a
+// third of the keys added, or once half again the keys it was sized for were
+// added. Empty until then, it lets every key through.
+template <size_t B = 12>
+class intrhash_bloom_filter {
+public:
+    intrhash_bloom_filter() = default;
+
+    explicit intrhash_bloom_filter(size_t n)
+        : blocks_((n * B + block_bits_ - 1) / block_bits_)
+        , capacity_(n)
+    {}
+
+    void add(size_t hash) noexcept {
+        ++nkeys_;
+
+        if (!blocks_.empty()) {
+            const uint64_t h = mix_(hash);
+            block_t& block = blocks_[index_(h)];
+
+            for (size_t i = 0; i != 8; ++i) {
+                block.words[i] |= bit_(h, i);
+            }
+        }
+    }
+
+    bool may_contain(size_t hash) const noexcept {
+        if (blocks_.empty()) {
+            return true;
+        }
+
+        const uint64_t h = mix_(hash);
+        const block_t& block = blocks_[index_(h)];
+        uint64_t missing = 0;
+
+        for (size_t i = 0; i != 8; ++i) {
+            missing |= bit_(h, i) & ~block.words[i];
+        }
+
+        return !missing;
+    }
+
+    void prefetch(size_t hash) const noexcept {
+        if (!blocks_.empty()) {
+            intrhash_util::prefetch(&blocks_[index_(mix_(hash))]);
+        }
+    }
+
+    bool stale(size_t nitems) const noexcept {
+        return nkeys_ > capacity_ + capacity_ / 2 + 64 || nkeys_ > nitems + nitems / 2 + 64;
+    }
+
+    void swap(intrhash_bloom_filter& right) noexcept {
+        blocks_.swap(right.blocks_);
+        std::swap(capacity_, right.capacity_);
+        std::swap(nkeys_, right.nkeys_);
+    }
+
+private:
+    struct alignas(64) block_t {
+        uint64_t words[8];
+    };
+
+    static constexpr size_t block_bits_ = sizeof(block_t) * 8;
+
+    static constexpr uint32_t salts_[8] = {
+        0x47b6137bu, 0x44974d91u, 0x8824ad5bu, 0xa2b7289du, 0x705495c7u, 0x2df1424bu, 0x9efc4947u, 0x5c6bfb31u,
+    };
+
+    // identity hashes of small integers would all land in block 0
+    static uint64_t mix_(size_t hash) noexcept {
+        uint64_t h = static_cast<uint64_t>(hash);
+        h = (h ^ (h >> 33)) * 0xff51afd7ed558ccdull;
+        h = (h ^ (h >> 33)) * 0xc4ceb9fe1a85ec53ull;
+        return h ^ (h >> 33);
+    }
+
+    size_t index_(uint64_t h) const noexcept {
+        return static_cast<size_t>(((h >> 32) * blocks_.size()) >> 32);
+    }
+
+    static uint64_t bit_(uint64_t h, size_t i) noexcept {
+        return uint64_t(1) << ((static_cast<uint32_t>(h) * salts_[i]) >> 26);
+    }
+
+private:
+    std::vector<block_t> blocks_;
+    size_t capacity_ = 0;
+    size_t nkeys_ = 0;
+};
+
+struct generic_intrhash_policy {
+    // least rehash work done per insert while a rehash is pending; 0 rehashes
+    // the whole table at once. Erases do the part of it that moves no item,
+    // and lookups none, so neither invalidates an iterator
+    static constexpr size_t rehash_step = 0;
+
+    // initial per-table load factors; a zero min_load_factor never shrinks on erase
+    static constexpr float max_load_factor = 1.0f;
+    static constexpr float min_load_factor = 0.0f;
+
+    template <class T>
+    using item = intrhash_item_t<T>;
+
+    using buckets = prime_intrhash_buckets;
+
+    using stats = intrhash_nostats;
+
+    // a negative lookup filter, asked before the bucket on every query
+    using filter = intrhash_nofilter;
+
+    // top bits of the hash kept in each pointer to an item, so that a chain
+    // walk compares keys only on a match; capped by pointer_tag_bits
+    static constexpr unsigned fingerprint_bits = 0;
+};
+
+struct incremental_intrhash_policy
+    : public generic_intrhash_policy
+{
+    static constexpr size_t rehash_step = 4;
+};
+
+struct hashed_intrhash_policy
+    : public generic_intrhash_policy
+{
+    template <class T>
+    using item = intrhash_hashed_item_t<T>;
+};
+
+struct pow2_intrhash_policy
+    : public generic_intrhash_policy
+{
+    using buckets = pow2_intrhash_buckets;
+};
+
+struct stats_intrhash_policy
+    : public generic_intrhash_policy
+{
+    using stats = intrhash_stats;
+};
+
+struct linked_intrhash_policy
+    : public generic_intrhash_policy
+{
+    template <class T>
+    using item = intrhash_linked_item_t<T>;
+};
+
+// for tables most of whose lookups miss; costs 1.5 bytes per key
+struct bloom_intrhash_policy
+    : public generic_intrhash_policy
+{
+    using filter = intrhash_bloom_filter<>;
+};
+
+// wants a hash whose top bits vary, e.g. intrhash_fast_ops rather than an
+// identity std::hash
+struct fingerprint_intrhash_policy
+    : public generic_intrhash_policy
+{
+    static constexpr unsigned fingerprint_bits = 16;
+};
+
+template <class T, class O, class A = std::allocator<T>, class P = generic_intrhash_policy>
+class intrhash_t
+    : private P::stats
+    , private P::filter
+    , private intrhash_priv::order_list_t<typename P::template item<T>>
+{
 protected:
-    using item_type = intrhash_item_t<T>;
+    using item_type = typename P::template item<T>;
     using node_type = typename item_type::node_type;
 
     using allocator_type = A;
@@ -297,7 +870,7 @@ private:
         }
 
         item_type* item() const noexcept {
-            return *ptr_;
+            return untag_(*ptr_);
         }
 
         node_type* node() const noexcept {
@@ -314,6 +887,39 @@ private:
 private:
     static constexpr uintptr_t bucket_flag_ = 1ul;
 
+    // the fingerprint of an item sits in every pointer to it: bucket slots
+    // and next_ alike; pointers to buckets carry none
+    static constexpr unsigned tag_bits_ = std::min(P::fingerprint_bits, intrhash_util::pointer_tag_bits);
+    static constexpr unsigned tag_shift_ = 48;
+
+    static_assert(P::fingerprint_bits <= 16, "fingerprint_bits must fit above bit 48");
+
+    static constexpr uintptr_t tag_mask_() noexcept {
+        if constexpr (tag_bits_ != 0) {
+            return ((uintptr_t(1) << tag_bits_) - 1) << tag_shift_;
+        } else {
+            return 0;
+        }
+    }
+
+    static constexpr uintptr_t hash_tag_(size_t hash) noexcept {
+        if constexpr (tag_bits_ != 0) {
+            return static_cast<uintptr_t>(hash >> (sizeof(size_t) * 8 - tag_bits_)) << tag_shift_;
+        } else {
+            return 0;
+        }
+    }
+
+    template <class I>
+    static I* untag_(I* item) noexcept {
+        return reinterpret_cast<I*>(reinterpret_cast<uintptr_t>(item) & ~tag_mask_());
+    }
+
+    template <class C>
+    static uintptr_t ctx_tag_(C ctx) noexcept {
+        return reinterpret_cast<uintptr_t>(*ctx.ptr()) & tag_mask_();
+    }
+
     template <class C>
     static bool ctx_bucket_(C ctx) noexcept {
         return reinterpret_cast<uintptr_t>(*ctx.ptr()) & bucket_flag_;
@@ -342,14 +948,24 @@ private:
         return ctx;
     }
 
+    template <class K>
+    static bool item_relative_(const item_type* item, const K& key, size_t hash) noexcept {
+        return (!item_type::cached_hash || item->template hash<O>() == hash) && O::equal_to(O::extract_key(*item->node()), key);
+    }
+
+    // a fingerprint mismatch settles it without a look at the node's key
     template <class C, class K>
-    static bool ctx_relative_(C ctx, const K& key) noexcept {
-        return O::equal_to(O::extract_key(*ctx.node()), key);
+    static bool ctx_relative_(C ctx, const K& key, size_t hash) noexcept {
+        return ctx_tag_(ctx) == hash_tag_(hash) && item_relative_(ctx.item(), key, hash);
     }
 
-    static void push_item_(context_type ctx, item_type* item) noexcept {
-        item->set_next(ctx.item());
-        *ctx.ptr() = item;
+    static void push_tagged_item_(context_type ctx, item_type* item, uintptr_t tag) noexcept {
+        item->set_next(*ctx.ptr());
+        *ctx.ptr() = reinterpret_cast<item_type*>(reinterpret_cast<uintptr_t>(item) | tag);
+    }
+
+    static void push_item_(context_type ctx, item_type* item, size_t hash) noexcept {
+        push_tagged_item_(ctx, item, hash_tag_(hash));
     }
 
     static item_type* pop_item_(context_type ctx) noexcept {
@@ -361,77 +977,567 @@ private:
 
 private:
     using buckets_type = oneshot_vector::oneshot_vector_t<item_type*, A>;
+    using shape_type = typename P::buckets;
+    using stats_type = typename P::stats;
+
+    const stats_type& stats_() const noexcept {
+        return *this;
+    }
+
+    stats_type& stats_() noexcept {
+        return *this;
+    }
+
+    using filter_type = typename P::filter;
+
+    const filter_type& filter_() const noexcept {
+        return *this;
+    }
+
+    filter_type& filter_() noexcept {
+        return *this;
+    }
+
+    // true when the filter rules the key out, with no bucket read
+    bool filtered_(size_t hash) const noexcept {
+        if (filter_().may_contain(hash)) {
+            return false;
+        }
+
+        stats_().on_lookup(0, false);
+        return true;
+    }
+
+    // failing to rebuild keeps the old filter, which still lets every key through
+    void refresh_filter_() noexcept {
+        if (filter_().stale(nitems_)) {
+            try {
+                filter_type filter(std::max(max_items_, nitems_));
+
+                for (const_context_type ctx = first_ctx_<const_context_type>(this), end_ctx = last_ctx_<const_context_type>(this); ctx.ptr() != end_ctx.ptr();) {
+                    if (ctx_item_(ctx)) {
+                        filter.add(item_hash_(ctx.item()));
+                        ctx = next_ctx_item_(ctx);
+                    } else {
+                        ctx = next_ctx_bucket_(ctx);
+                    }
+                }
+
+                filter_().swap(filter);
+            } catch (...) {
+            }
+        }
+    }
+
+    using order_type = intrhash_priv::order_list_t<item_type>;
+
+    const order_type& order_() const noexcept {
+        return *this;
+    }
+
+    order_type& order_() noexcept {
+        return *this;
+    }
+
+    // links before the given item, or at the tail when there is none
+    void link_order_(item_type* item, item_type* next) noexcept {
+        if constexpr (item_type::ordered) {
+            item_type* const prev = next ? next->before() : order_().tail;
+
+            item->set_before(prev);
+            item->set_after(next);
+
+            if (prev) {
+                prev->set_after(item);
+            } else {
+                order_().head = item;
+            }
+
+            if (next) {
+                next->set_before(item);
+            } else {
+                order_().tail = item;
+            }
+        }
+    }
+
+    void unlink_order_(item_type* item) noexcept {
+        if constexpr (item_type::ordered) {
+            item_type* const prev = item->before();
+            item_type* const next = item->after();
+
+            if (prev) {
+                prev->set_after(next);
+            } else {
+                order_().head = next;
+            }
+
+            if (next) {
+                next->set_before(prev);
+            } else {
+                order_().tail = prev;
+            }
+
+            item->set_before(nullptr);
+            item->set_after(nullptr);
+        }
+    }
+
+    // links each of the slots [first, last) to the one after it
+    static void init_buckets_(buckets_type* bkts, size_t first, size_t last) noexcept {
+        for (auto bucket = bkts->begin() + first; first != last; ++first) {
+            const auto current = bucket;
+            *current = reinterpret_cast<item_type*>(reinterpret_cast<uintptr_t>(&*++bucket) | bucket_flag_);
+        }
+    }
 
     static void init_buckets_(buckets_type* bkts) noexcept {
         if (!bkts->empty()) {
-            auto bucket = bkts->begin();
-            auto last = bkts->end();
+            init_buckets_(bkts, 0, bkts->size() - 1);
+            *(bkts->end() - 1) = nullptr;
+        }
+    }
+
+    static size_t item_hash_(const item_type* item) noexcept {
+        return item->template hash<O>();
+    }
+
+private:
+    template <class C, class B>
+    static C bucket_ctx_(B& bkts, const shape_type& shape, size_t hash) noexcept {
+        return &bkts[shape.index(hash)];
+    }
+
+    template <class C, class X>
+    static C base_ctx_(X* ths, size_t hash) noexcept {
+        if (ths->rehashing_()) {
+            const size_t n = ths->old_shape_.index(hash);
+
+            if (n >= ths->migrated_) {
+                return &ths->old_buckets_[n];
+            }
+        }
+
+        return bucket_ctx_<C>(ths->buckets_, ths->shape_, hash);
+    }
+
+    context_type base_ctx_(size_t hash) noexcept {
+        return base_ctx_<context_type>(this, hash);
+    }
+
+    const_context_type base_ctx_(size_t hash) const noexcept {
+        return base_ctx_<const_context_type>(this, hash);
+    }
+
+    template <class C, class X>
+    static C first_ctx_(X* ths) noexcept {
+        return &*(ths->rehashing_() ? ths->old_buckets_ : ths->buckets_).begin();
+    }
 
-            --last;
+    // the slot ending the chain of buckets; new buckets join it once linked
+    template <class C, class X>
+    static C last_ctx_(X* ths) noexcept {
+        return &*((ths->linked_() ? ths->buckets_ : ths->old_buckets_).end() - 1);
+    }
+
+    template <class S, class C, class K>
+    static std::pair<C, bool> find_chain_ctx_(const S& stats, C ctx, const K& key, size_t hash) noexcept {
+        size_t steps = 0;
+
+        for (; ctx_item_(ctx); ctx = next_ctx_item_(ctx)) {
+            ++steps;
+
+            if (ctx_relative_(ctx, key, hash)) {
+                stats.on_lookup(steps, true);
+                return {ctx, true};
+            }
+        }
+
+        stats.on_lookup(steps, false);
+        return {ctx, false};
+    }
+
+    template <class C, class X, class K>
+    static std::pair<C, bool> find_ctx_(X* ths, const K& key, size_t hash) noexcept {
+        return find_chain_ctx_(ths->stats_(), base_ctx_<C>(ths, hash), key, hash);
+    }
+
+    template <class C, class K>
+    static size_t count_ctx_(std::pair<C, bool> found_ctx, const K& key, size_t hash) noexcept {
+        if (!found_ctx.second) {
+            return 0;
+        }
+
+        size_t result = 0;
+
+        do {
+            ++result;
+            found_ctx.first = next_ctx_item_(found_ctx.first);
+        } while (ctx_item_(found_ctx.first) && ctx_relative_(found_ctx.first, key, hash));
+
+        return result;
+    }
+
+    static constexpr size_t batch_size_ = 16;
+
+    // hashes a batch of keys and prefetches their bucket slots and first nodes
+    // before walking any chain, so the cache misses of the batch overlap
+    template <class C, class X, class I, class F>
+    static void find_batch_(X* ths, I first, I last, F&& cbk) {
+        size_t hashes[batch_size_];
+        typename C::item_ptr* slots[batch_size_];
+
+        while (first != last) {
+            I keys = first;
+            size_t n = 0;
+
+            for (; first != last && n != batch_size_; ++first, ++n) {
+                hashes[n] = O::hash(*first);
+                ths->filter_().prefetch(hashes[n]);
+            }
+
+            // a key the filter rules out gets no slot
+            for (size_t i = 0; i != n; ++i) {
+                slots[i] = ths->filtered_(hashes[i]) ? nullptr : base_ctx_<C>(ths, hashes[i]).ptr();
+                intrhash_util::prefetch(slots[i]);
+            }
 
-            while (bucket != last) {
-                const auto current = bucket;
-                *current = reinterpret_cast<item_type*>(reinterpret_cast<uintptr_t>(&*++bucket) | bucket_flag_);
+            for (size_t i = 0; i != n; ++i) {
+                if (slots[i] && ctx_item_(C(slots[i]))) {
+                    intrhash_util::prefetch(C(slots[i]).node());
+                }
             }
 
-            *bucket = nullptr;
+            for (size_t i = 0; i != n; ++i, ++keys) {
+                cbk(slots[i] ? find_chain_ctx_(ths->stats_(), C(slots[i]), *keys, hashes[i]) : std::pair<C, bool>(C(nullptr), false), *keys, hashes[i]);
+            }
         }
     }
 
+    template <class K>
+    std::pair<context_type, bool> find_ctx_(const K& key, size_t hash) noexcept {
+        return find_ctx_<context_type>(this, key, hash);
+    }
+
+    template <class K>
+    std::pair<const_context_type, bool> find_ctx_(const K& key, size_t hash) const noexcept {
+        return find_ctx_<const_context_type>(this, key, hash);
+    }
+
+    template <class K>
+    std::pair<context_type, bool> find_ctx_(const K& key) noexcept {
+        return find_ctx_(key, O::hash(key));
+    }
+
+    template <class K>
+    std::pair<const_context_type, bool> find_ctx_(const K& key) const noexcept {
+        return find_ctx_(key, O::hash(key));
+    }
+
+    template <class I, class X, class K>
+    static std::pair<I, I> equal_range_impl_(X* ths, const K& key, size_t hash) noexcept {
+        if (ths->filtered_(hash)) {
+            return {ths->end(), ths->end()};
+        }
+
+        const auto found_ctx = ths->find_ctx_(key, hash);
+
+        if (!found_ctx.second) {
+            return {ths->end(), ths->end()};
+        }
+
+        // equal keys are adjacent in the insertion order list as well, but
+        // the chain may list them in another order after a rehash
+        if constexpr (item_type::ordered) {
+            auto first = found_ctx.first.item();
+            auto last = first;
+
+            while (first->before() && item_relative_(first->before(), key, hash)) {
+                first = first->before();
+            }
+
+            while (last->after() && item_relative_(last->after(), key, hash)) {
+                last = last->after();
+            }
+
+            return {first, last->after()};
+        }
+
+        auto last = found_ctx.first;
+
+        do {
+            last = next_ctx_item_(last);
+        } while (ctx_item_(last) && ctx_relative_(last, key, hash));
+
+        return {found_ctx.first.item(), item_ctx_(last).item()};
+    }
+
 private:
-    template <class C, class B, class K>
-    static C base_ctx_(B& bkts, const K& key) noexcept {
-        return &bkts[(O::hash(key) % (bkts.size() - 1))];
+    bool rehashing_() const noexcept {
+        return P::rehash_step && !old_buckets_.empty();
     }
 
-    template <class K>
-    context_type base_ctx_(const K& key) noexcept {
-        return base_ctx_<context_type>(buckets_, key);
-    }
+    // the new buckets of a rehash are initialized a slice per step; until the
+    // last one is, every item stays in the old buckets, which end the chain
+    bool linked_() const noexcept {
+        return !rehashing_() || initialized_ == buckets_.size() - 1;
+    }
+
+    void migrate_bucket_() noexcept {
+        for (context_type ctx = &old_buckets_[migrated_]; ctx_item_(ctx);) {
+            item_type* const item = pop_item_(ctx);
+            const size_t hash = item_hash_(item);
+            push_item_(bucket_ctx_<context_type>(buckets_, shape_, hash), item, hash);
+        }
+
+        if (++migrated_ == old_buckets_.size() - 1) {
+            old_buckets_ = buckets_type();
+            migrated_ = 0;
+        }
+    }
+
+    // a slice of about as many new buckets as one old bucket maps to, or once
+    // they are all linked, one old bucket
+    void rehash_unit_() noexcept {
+        if (linked_()) {
+            migrate_bucket_();
+            return;
+        }
+
+        const size_t stride = (shape_.size() + old_shape_.size() - 1) / old_shape_.size();
+        const size_t last = std::min(initialized_ + stride, buckets_.size() - 1);
+
+        init_buckets_(&buckets_, initialized_, last);
+        initialized_ = last;
+
+        if (linked_()) {
+            *(old_buckets_.end() - 1) = reinterpret_cast<item_type*>(reinterpret_cast<uintptr_t>(&*buckets_.begin()) | bucket_flag_);
+        }
+    }
+
+    void rehash_step_() noexcept {
+        for (size_t n = rehash_work_; n && rehashing_(); --n) {
+            rehash_unit_();
+        }
+    }
+
+    // what an erase may do of a step: link new buckets and pass empty old
+    // ones, which moves no item, so iterators held across it stay valid
+    void erase_step_() noexcept {
+        for (size_t n = rehash_work_; n && rehashing_(); --n) {
+            if (linked_() && ctx_item_(context_type(&old_buckets_[migrated_]))) {
+                break;
+            }
+
+            rehash_unit_();
+        }
+    }
+
+    void finish_rehash_() noexcept {
+        while (rehashing_()) {
+            rehash_unit_();
+        }
+    }
+
+    // for callers about to empty the old buckets by other means
+    void drop_old_buckets_() noexcept {
+        if (!linked_()) {
+            init_buckets_(&buckets_, initialized_, buckets_.size() - 1);
+        }
+
+        old_buckets_ = buckets_type();
+        migrated_ = 0;
+    }
+
+    size_t buckets_for_(size_t n, float load) const noexcept {
+        return static_cast<size_t>(std::ceil(static_cast<double>(n) / load));
+    }
+
+    void update_limits_() noexcept {
+        max_items_ = static_cast<size_t>(static_cast<double>(shape_.size()) * max_load_);
+        min_items_ = static_cast<size_t>(static_cast<double>(shape_.size()) * min_load_);
+    }
+
+    void rehash_to_(const shape_type& shape) {
+        const auto start = stats_().on_resize_begin();
+        buckets_type buckets(shape.size() + 1, buckets_.get_allocator());
+        filter_type filter(std::max(static_cast<size_t>(static_cast<double>(shape.size()) * max_load_), nitems_));
+        size_t nitems = 0;
+
+        init_buckets_(&buckets);
+        decompose_chains_([&buckets, &shape, &filter, &nitems](item_type* item){
+            const size_t hash = item_hash_(item);
+            push_item_(bucket_ctx_<context_type>(buckets, shape, hash), item, hash);
+            filter.add(hash);
+            ++nitems;
+        });
+        buckets_.swap(buckets);
+        filter_().swap(filter);
+        shape_ = shape;
+        nitems_ = nitems;
+        update_limits_();
+        stats_().on_resize_end(start);
+    }
+
+    template <class E>
+    void parallel_rehash_to_(const shape_type& shape, E& exec) {
+        using list_type = std::pair<item_type*, item_type*>;
+
+        const auto start = stats_().on_resize_begin();
+        const size_t nparts = std::max<size_t>(exec.concurrency(), 1);
+        const size_t nold = shape_.size();
+
+        buckets_type buckets(shape.size() + 1, buckets_.get_allocator());
+        std::vector<list_type> lists(nparts * nparts, list_type(nullptr, nullptr));
+        std::vector<char> done(nparts);
+        std::exception_ptr error;
+
+        // the first pass leaves the old chains as lists, so a failing exec
+        // must not leave the table half split: the parts it did not run are
+        // run here, and its exception is rethrown once the table is whole
+        const auto run = [&exec, &done, &error, nparts](const auto& task) {
+            if (!error) {
+                try {
+                    exec([&task, &done](size_t part){
+                        task(part);
+                        done[part] = 1;
+                    });
+                    return;
+                } catch (...) {
+                    error = std::current_exception();
+                }
+            }
+
+            for (size_t part = 0; part != nparts; ++part) {
+                if (!done[part]) {
+                    task(part);
+                }
+            }
+        };
+
+        init_buckets_(&buckets);
+        finish_rehash_();
+
+        run([this, &shape, &lists, nparts, nold](size_t part){
+            list_type* const parts = &lists[part * nparts];
 
-    template <class K>
-    const_context_type base_ctx_(const K& key) const noexcept {
-        return base_ctx_<const_context_type>(buckets_, key);
-    }
+            for (size_t i = nold * part / nparts; i != nold * (part + 1) / nparts; ++i) {
+                for (item_type* item = untag_(buckets_[i]); !(reinterpret_cast<uintptr_t>(item) & bucket_flag_);) {
+                    item_type* const next = untag_(item->next());
+                    list_type& list = parts[shape.index(item_hash_(item)) * nparts / shape.size()];
 
-    template <class C, class B, class K>
-    static std::pair<C, bool> find_ctx_(B& bkts, const K& key) noexcept {
-        C ctx = base_ctx_<C>(bkts, key);
+                    if (list.second) {
+                        list.second->set_next(item);
+                    } else {
+                        list.first = item;
+                    }
 
-        for (; ctx_item_(ctx); ctx = next_ctx_item_(ctx)) {
-            if (ctx_relative_(ctx, key)) {
-                return {ctx, true};
+                    list.second = item;
+                    item = next;
+                }
             }
-        }
 
-        return {ctx, false};
-    }
+            for (size_t i = 0; i != nparts; ++i) {
+                if (parts[i].second) {
+                    parts[i].second->set_next(nullptr);
+                }
+            }
+        });
+
+        std::fill(done.begin(), done.end(), 0);
+        run([&buckets, &shape, &lists, nparts](size_t part){
+            for (size_t i = 0; i != nparts; ++i) {
+                for (item_type* item = lists[i * nparts + part].first; item;) {
+                    item_type* const next = item->next();
+                    const size_t hash = item_hash_(item);
+                    push_item_(bucket_ctx_<context_type>(buckets, shape, hash), item, hash);
+                    item = next;
+                }
+            }
+        });
 
-    template <class K>
-    std::pair<context_type, bool> find_ctx_(const K& key) noexcept {
-        return find_ctx_<context_type>(buckets_, key);
-    }
+        buckets_.swap(buckets);
+        shape_ = shape;
+        update_limits_();
+        stats_().on_resize_end(start);
 
-    template <class K>
-    std::pair<const_context_type, bool> find_ctx_(const K& key) const noexcept {
-        return find_ctx_<const_context_type>(buckets_, key);
+        if (error) {
+            std::rethrow_exception(error);
+        }
     }
 
-    template <class I, class X, class K>
-    static std::pair<I, I> equal_range_impl_(X* ths, const K& key) noexcept {
-        const auto found_ctx = ths->find_ctx_(key);
+    // swaps in buckets of the given shape as the new ones and leaves the
+    // items in the old ones, for rehash steps to migrate
+    void start_rehash_(const shape_type& shape) {
+        // the new slots are left as allocated, but for the one ending the
+        // chain; rehash steps initialize the rest
+        const auto start = stats_().on_resize_begin();
+        buckets_type buckets(shape.size() + 1, buckets_.get_allocator());
+        *(buckets.end() - 1) = nullptr;
+
+        // steps are sized to finish before the table outgrows the new
+        // buckets, so one is left here only if the load limits changed
+        finish_rehash_();
+
+        old_buckets_.swap(buckets_);
+        buckets_.swap(buckets);
+        old_shape_ = shape_;
+        shape_ = shape;
+        initialized_ = 0;
+        update_limits_();
+
+        // a unit per old bucket to initialize the new ones, and one to
+        // migrate it, spread over the first half of the inserts until the
+        // next growth; erases do what they can and only widen that
+        const size_t budget = std::max<size_t>((max_items_ - std::min(max_items_, nitems_)) / 2, 1);
+        rehash_work_ = std::max(P::rehash_step, (2 * old_shape_.size() + budget - 1) / budget);
+        stats_().on_resize_end(start);
+    }
+
+    // shrinks to the middle of the load factor range, so that neither the next
+    // insert nor the next erase flips the table back; failing to shrink is
+    // harmless. An incremental table shrinks by migration as it grows, once
+    // no rehash is pending
+    void shrink_() noexcept {
+        erase_step_();
+
+        if (nitems_ < min_items_ && !rehashing_()) {
+            const shape_type shape(buckets_for_(nitems_, (min_load_ + max_load_) / 2));
+
+            if (shape.size() < shape_.size()) {
+                try {
+                    if (!P::rehash_step) {
+                        rehash_to_(shape);
+                    } else {
+                        start_rehash_(shape);
+                    }
+                } catch (...) {
+                }
+            }
+        }
 
-        if (!found_ctx.second) {
-            return {ths->end(), ths->end()};
+        refresh_filter_();
+    }
+
+    void grow_(size_t n) {
+        if (n <= max_items_) {
+            rehash_step_();
+            refresh_filter_();
+            return;
         }
 
-        auto last = found_ctx.first;
+        const shape_type shape(buckets_for_(n, max_load_));
 
-        do {
-            last = next_ctx_item_(last);
-        } while (ctx_item_(last) && ctx_relative_(last, key));
+        if (shape.size() > shape_.size()) {
+            if (!P::rehash_step) {
+                rehash_to_(shape);
+            } else {
+                start_rehash_(shape);
+                rehash_step_();
+            }
+        }
 
-        return {found_ctx.first.item(), item_ctx_(last).item()};
+        refresh_filter_();
     }
 
 private:
@@ -476,7 +1582,11 @@ private:
         }
 
         void next() noexcept {
-            item_ = item_ctx_(context_type(item_->next_ptr())).item();
+            if constexpr (item_type::ordered) {
+                item_ = item_->after();
+            } else {
+                item_ = item_ctx_(context_type(item_->next_ptr())).item();
+            }
         }
 
     public:
@@ -524,7 +1634,11 @@ public:
 
 public:
     iterator begin() noexcept {
-        return {item_ctx_<context_type>(&*buckets_.begin()).item()};
+        if constexpr (item_type::ordered) {
+            return {order_().head};
+        } else {
+            return {item_ctx_(first_ctx_<context_type>(this)).item()};
+        }
     }
 
     iterator end() noexcept {
@@ -532,7 +1646,11 @@ public:
     }
 
     const_iterator begin() const noexcept {
-        return {item_ctx_<const_context_type>(&*buckets_.begin()).item()};
+        if constexpr (item_type::ordered) {
+            return {order_().head};
+        } else {
+            return {item_ctx_(first_ctx_<const_context_type>(this)).item()};
+        }
     }
 
     const_iterator end() const noexcept {
@@ -547,11 +1665,13 @@ public:
         return end();
     }
 
-public:
+private:
+    // walks every bucket, so that rehash_to_() can take the chains apart
+    // without touching the insertion order list
     template <class F>
-    void decompose(F&& cbk) {
+    void decompose_chains_(F&& cbk) {
         if (nitems_) {
-            for (context_type ctx = &*buckets_.begin(), end_ctx = &*(buckets_.end() - 1); ctx.ptr() != end_ctx.ptr();) {
+            for (context_type ctx = first_ctx_<context_type>(this), end_ctx = last_ctx_<context_type>(this); ctx.ptr() != end_ctx.ptr();) {
                 if (ctx_item_(ctx)) {
                     --nitems_;
                     cbk(pop_item_(ctx)->node());
@@ -560,86 +1680,307 @@ public:
                 }
             }
         }
+
+        drop_old_buckets_();
+    }
+
+    void reset_bucket_(const item_type* item) noexcept {
+        const context_type ctx = base_ctx_(item_hash_(item));
+        *ctx.ptr() = reinterpret_cast<item_type*>(reinterpret_cast<uintptr_t>(ctx.ptr() + 1) | bucket_flag_);
+    }
+
+public:
+    // an ordered table visits only its items: each one empties its bucket
+    // before it is handed out, instead of every bucket being scanned
+    template <class F>
+    void decompose(F&& cbk) {
+        if constexpr (item_type::ordered) {
+            for (item_type* item = order_().head; item;) {
+                item_type* const next = item->after();
+
+                reset_bucket_(item);
+                item->set_next(nullptr);
+                item->set_before(nullptr);
+                item->set_after(nullptr);
+                --nitems_;
+                cbk(item->node());
+                item = next;
+            }
+
+            order_().head = order_().tail = nullptr;
+            drop_old_buckets_();
+        } else {
+            decompose_chains_(std::forward<F>(cbk));
+        }
+
+        filter_type().swap(filter_());
     }
 
     void decompose() noexcept {
         decompose([](node_type*){});
     }
 
+    // drops every item without touching it, for owners that free all of them
+    // at once; costs a pass over the buckets instead of the items
+    void abandon() noexcept {
+        init_buckets_(&buckets_);
+        old_buckets_ = buckets_type();
+        migrated_ = 0;
+        nitems_ = 0;
+        filter_type().swap(filter_());
+
+        if constexpr (item_type::ordered) {
+            order_().head = order_().tail = nullptr;
+        }
+    }
+
     void resize(size_t n) {
-        if (n > buckets_.size() - 1) {
-            const size_t nbuckets = intrhash_priv::buckets_count(n) + 1;
+        if (n > shape_.size()) {
+            const shape_type shape(n);
+
+            if (shape.size() > shape_.size()) {
+                rehash_to_(shape);
+            }
+        }
+    }
+
+    // rehashes on exec.concurrency() workers: each one first splits the chains of
+    // its share of the old buckets into one list per destination bucket range,
+    // then each one links the lists of its own destination range. exec may throw
+    // only before starting a task or after it has ended; the table is resized
+    // all the same before the exception goes on
+    template <class E>
+    void resize(size_t n, E&& exec) {
+        if (n > shape_.size()) {
+            const shape_type shape(n);
+
+            if (shape.size() > shape_.size()) {
+                parallel_rehash_to_(shape, exec);
+            }
+        }
+    }
+
+    void reserve(size_t n) {
+        resize(buckets_for_(n, max_load_));
+    }
+
+    void rehash(size_t n) {
+        const shape_type shape(std::max(n, buckets_for_(nitems_, max_load_)));
+
+        if (shape.size() != shape_.size()) {
+            rehash_to_(shape);
+        }
+    }
+
+    void shrink_to_fit() {
+        rehash(0);
+    }
+
+public:
+    size_t bucket_count() const noexcept {
+        return shape_.size();
+    }
+
+    float load_factor() const noexcept {
+        return static_cast<float>(nitems_) / shape_.size();
+    }
+
+    float max_load_factor() const noexcept {
+        return max_load_;
+    }
+
+    void max_load_factor(float load) {
+        max_load_ = load;
+        update_limits_();
+        reserve(nitems_);
+    }
+
+    float min_load_factor() const noexcept {
+        return min_load_;
+    }
+
+    const stats_type& stats() const noexcept {
+        return stats_();
+    }
+
+    stats_type& stats() noexcept {
+        return stats_();
+    }
+
+    // result[k] is the number of buckets holding k items
+    std::vector<size_t> bucket_histogram() const {
+        std::vector<size_t> result;
+
+        const auto add = [&result](const_context_type ctx){
+            size_t n = 0;
+
+            for (; ctx_item_(ctx); ctx = next_ctx_item_(ctx)) {
+                ++n;
+            }
+
+            if (n >= result.size()) {
+                result.resize(n + 1);
+            }
+
+            ++result[n];
+        };
 
-            if (nbuckets > buckets_.size()) {
-                buckets_type buckets(nbuckets, buckets_.get_allocator());
-                size_t nitems = 0;
+        if (rehashing_()) {
+            for (size_t i = migrated_; i != old_shape_.size(); ++i) {
+                add(&old_buckets_[i]);
+            }
+        }
 
-                init_buckets_(&buckets);
-                decompose([this, &buckets, &nitems](item_type* item){
-                    push_item_(base_ctx_<context_type>(buckets, O::extract_key(*item->node())), item);
-                    ++nitems;
-                });
-                buckets_.swap(buckets);
-                nitems_ = nitems;
+        if (linked_()) {
+            for (size_t i = 0; i != shape_.size(); ++i) {
+                add(&buckets_[i]);
             }
+        } else {
+            result.resize(std::max<size_t>(result.size(), 1));
+            result[0] += shape_.size();
         }
+
+        return result;
+    }
+
+    void min_load_factor(float load) noexcept {
+        min_load_ = load;
+        update_limits_();
     }
 
 public:
+    // the overloads taking a hash skip O::hash(key); it must be that value,
+    // so that one hash can probe every table sharing O
     template <class K>
-    iterator find(const K& key) noexcept {
-        const auto found_ctx = find_ctx_(key);
+    iterator find(const K& key, size_t hash) noexcept {
+        if (filtered_(hash)) {
+            return end();
+        }
+
+        const auto found_ctx = find_ctx_(key, hash);
         return found_ctx.second ? iterator(found_ctx.first.item()) : end();
     }
 
     template <class K>
-    const_iterator find(const K& key) const noexcept {
-        const auto found_ctx = find_ctx_(key);
+    const_iterator find(const K& key, size_t hash) const noexcept {
+        if (filtered_(hash)) {
+            return end();
+        }
+
+        const auto found_ctx = find_ctx_(key, hash);
         return found_ctx.second ? const_iterator(found_ctx.first.item()) : end();
     }
 
     template <class K>
-    node_type* find_ptr(const K& key) noexcept {
-        const auto found_ctx = find_ctx_(key);
+    iterator find(const K& key) noexcept {
+        return find(key, O::hash(key));
+    }
+
+    template <class K>
+    const_iterator find(const K& key) const noexcept {
+        return find(key, O::hash(key));
+    }
+
+    template <class K>
+    node_type* find_ptr(const K& key, size_t hash) noexcept {
+        if (filtered_(hash)) {
+            return nullptr;
+        }
+
+        const auto found_ctx = find_ctx_(key, hash);
         return found_ctx.second ? found_ctx.first.node() : nullptr;
     }
 
     template <class K>
-    const node_type* find_ptr(const K& key) const noexcept {
-        const auto found_ctx = find_ctx_(key);
+    const node_type* find_ptr(const K& key, size_t hash) const noexcept {
+        if (filtered_(hash)) {
+            return nullptr;
+        }
+
+        const auto found_ctx = find_ctx_(key, hash);
         return found_ctx.second ? found_ctx.first.node() : nullptr;
     }
 
+    template <class K>
+    node_type* find_ptr(const K& key) noexcept {
+        return find_ptr(key, O::hash(key));
+    }
+
+    template <class K>
+    const node_type* find_ptr(const K& key) const noexcept {
+        return find_ptr(key, O::hash(key));
+    }
+
+    template <class K>
+    bool has(const K& key, size_t hash) const noexcept {
+        return !filtered_(hash) && find_ctx_(key, hash).second;
+    }
+
     template <class K>
     bool has(const K& key) const noexcept {
-        return find_ctx_(key).second;
+        return has(key, O::hash(key));
+    }
+
+    template <class K>
+    std::pair<iterator, iterator> equal_range(const K& key, size_t hash) noexcept {
+        return equal_range_impl_<iterator>(this, key, hash);
+    }
+
+    template <class K>
+    std::pair<const_iterator, const_iterator> equal_range(const K& key, size_t hash) const noexcept {
+        return equal_range_impl_<const_iterator>(this, key, hash);
     }
 
     template <class K>
     std::pair<iterator, iterator> equal_range(const K& key) noexcept {
-        return equal_range_impl_<iterator>(this, key);
+        return equal_range(key, O::hash(key));
     }
 
     template <class K>
     std::pair<const_iterator, const_iterator> equal_range(const K& key) const noexcept {
-        return equal_range_impl_<const_iterator>(this, key);
+        return equal_range(key, O::hash(key));
+    }
+
+    template <class K>
+    size_t count(const K& key, size_t hash) const noexcept {
+        return filtered_(hash) ? 0 : count_ctx_(find_ctx_(key, hash), key, hash);
     }
 
     template <class K>
     size_t count(const K& key) const noexcept {
-        const auto found_ctx = find_ctx_(key);
+        return count(key, O::hash(key));
+    }
 
-        if (!found_ctx.second) {
-            return 0;
-        }
+public:
+    template <class I, class R>
+    R find_batch(I first, I last, R result) {
+        find_batch_<context_type>(this, first, last, [this, &result](std::pair<context_type, bool> found_ctx, const typename std::iterator_traits<I>::value_type&, size_t){
+            *result++ = found_ctx.second ? iterator(found_ctx.first.item()) : end();
+        });
+        return result;
+    }
 
-        size_t result = 0;
+    template <class I, class R>
+    R find_batch(I first, I last, R result) const {
+        find_batch_<const_context_type>(this, first, last, [this, &result](std::pair<const_context_type, bool> found_ctx, const typename std::iterator_traits<I>::value_type&, size_t){
+            *result++ = found_ctx.second ? const_iterator(found_ctx.first.item()) : end();
+        });
+        return result;
+    }
 
-        do {
-            ++result;
-            found_ctx.first = next_ctx_item_(found_ctx.first);
-        } while (ctx_item_(found_ctx.first) && ctx_relative_(found_ctx.first, key));
+    template <class I, class R>
+    R has_batch(I first, I last, R result) const {
+        find_batch_<const_context_type>(this, first, last, [&result](std::pair<const_context_type, bool> found_ctx, const typename std::iterator_traits<I>::value_type&, size_t){
+            *result++ = found_ctx.second;
+        });
+        return result;
+    }
 
+    template <class I, class R>
+    R count_batch(I first, I last, R result) const {
+        find_batch_<const_context_type>(this, first, last, [&result](std::pair<const_context_type, bool> found_ctx, const typename std::iterator_traits<I>::value_type& key, size_t hash){
+            *result++ = count_ctx_(found_ctx, key, hash);
+        });
         return result;
     }
 
@@ -653,23 +1994,50 @@ public:
     }
 
 public:
-    node_type* push_no_resize(node_type* node) noexcept {
-        const auto ctx = find_ctx_(O::extract_key(*node)).first;
-        push_item_(ctx, node);
+    node_type* push_no_resize(node_type* node, size_t hash) noexcept {
+        const auto found_ctx = find_ctx_(O::extract_key(*node), hash);
+        const auto ctx = found_ctx.first;
+        link_order_(node, found_ctx.second ? ctx.item() : nullptr);
+        node->set_hash(hash);
+        push_item_(ctx, node, hash);
+        filter_().add(hash);
         ++nitems_;
         return ctx.node();
     }
 
-    node_type* push(node_type* node) noexcept {
-        resize(nitems_ + 1);
+    node_type* push_no_resize(node_type* node) noexcept {
+        return push_no_resize(node, O::hash(O::extract_key(*node)));
+    }
+
+    node_type* push(node_type* node, size_t hash) {
+        grow_(nitems_ + 1);
+        return push_no_resize(node, hash);
+    }
+
+    node_type* push(node_type* node) {
+        grow_(nitems_ + 1);
         return push_no_resize(node);
     }
 
+    // skips the lookup: the key must be new, or the key of the node pushed
+    // right before, as when a saved table is read back
+    node_type* push_new_no_resize(node_type* node) noexcept {
+        const size_t hash = O::hash(O::extract_key(*node));
+        node->set_hash(hash);
+        push_item_(base_ctx_(hash), node, hash);
+        link_order_(node, nullptr);
+        filter_().add(hash);
+        ++nitems_;
+        return node;
+    }
+
     node_type* pop(node_type* node) noexcept {
-        for (auto ctx = base_ctx_(O::extract_key(*node)); ctx_item_(ctx); ctx = next_ctx_item_(ctx)) {
+        for (auto ctx = base_ctx_(item_hash_(node)); ctx_item_(ctx); ctx = next_ctx_item_(ctx)) {
             if (ctx.node() == node) {
                 --nitems_;
-                return pop_item_(ctx)->node();
+                unlink_order_(pop_item_(ctx));
+                shrink_();
+                return node;
             }
         }
 
@@ -682,9 +2050,29 @@ public:
 
     template <class F>
     void pop(node_type* first, node_type* last, F&& cbk) {
-        for (auto ctx = base_ctx_(O::extract_key(*first)); ctx_item_(ctx); ctx = next_ctx_item_(ctx)) {
+        if constexpr (item_type::ordered) {
+            for (item_type* item = first; item != static_cast<item_type*>(last);) {
+                item_type* const next = item->after();
+
+                for (auto ctx = base_ctx_(item_hash_(item)); ctx_item_(ctx); ctx = next_ctx_item_(ctx)) {
+                    if (ctx.item() == item) {
+                        --nitems_;
+                        unlink_order_(pop_item_(ctx));
+                        cbk(item->node());
+                        break;
+                    }
+                }
+
+                item = next;
+            }
+
+            shrink_();
+            return;
+        }
+
+        for (auto ctx = base_ctx_(item_hash_(first)); ctx_item_(ctx); ctx = next_ctx_item_(ctx)) {
             if (ctx.node() == first) {
-                const context_type end_ctx = &*(buckets_.end() - 1);
+                const context_type end_ctx = last_ctx_<context_type>(this);
 
                 do {
                     if (ctx_item_(ctx)) {
@@ -699,6 +2087,7 @@ public:
                     }
                 } while (ctx.ptr() != end_ctx.ptr());
 
+                shrink_();
                 return;
             }
         }
@@ -710,40 +2099,138 @@ public:
     }
 
     template <class K>
-    node_type* pop_one(const K& key) noexcept {
-        const auto found_ctx = find_ctx_(key);
+    node_type* pop_one(const K& key, size_t hash) noexcept {
+        if (filtered_(hash)) {
+            return nullptr;
+        }
+
+        const auto found_ctx = find_ctx_(key, hash);
 
         if (found_ctx.second) {
             --nitems_;
-            return pop_item_(found_ctx.first)->node();
+            item_type* const item = pop_item_(found_ctx.first);
+            unlink_order_(item);
+            shrink_();
+            return item->node();
         } else {
             return nullptr;
         }
     }
 
+    template <class K>
+    node_type* pop_one(const K& key) noexcept {
+        return pop_one(key, O::hash(key));
+    }
+
     template <class K, class F>
-    void pop_all(const K& key, F&& cbk) {
-        const auto found_ctx = find_ctx_(key);
+    void pop_all(const K& key, size_t hash, F&& cbk) {
+        if (filtered_(hash)) {
+            return;
+        }
+
+        const auto found_ctx = find_ctx_(key, hash);
 
         if (found_ctx.second) {
             do {
                 --nitems_;
-                cbk(pop_item_(found_ctx.first)->node());
-            } while (ctx_item_(found_ctx.first) && ctx_relative_(found_ctx.first, key));
+                item_type* const item = pop_item_(found_ctx.first);
+                unlink_order_(item);
+                cbk(item->node());
+            } while (ctx_item_(found_ctx.first) && ctx_relative_(found_ctx.first, key, hash));
+
+            shrink_();
         }
     }
 
+    template <class K, class F>
+    void pop_all(const K& key, F&& cbk) {
+        pop_all(key, O::hash(key), std::forward<F>(cbk));
+    }
+
     template <class K>
     void pop_all(const K& key) noexcept {
         pop_all(key, [](node_type*){});
     }
 
+    // moves the items of right here, or with unique only those whose key is
+    // missing here; adopt(node) gets each one while still in right and returns
+    // the node to link, normally the same one, so nothing is copied. A node
+    // replaced by another goes to drop(node) once unlinked from right; if adopt
+    // throws, it stays in right
+    template <class F, class D>
+    void splice(intrhash_t& right, bool unique, F&& adopt, D&& drop) {
+        if (&right == this) {
+            return;
+        }
+
+        const auto take = [this, unique, &adopt, &drop](item_type* item, auto&& unlink) {
+            grow_(nitems_ + 1);
+
+            const size_t hash = item_hash_(item);
+            const auto found_ctx = find_ctx_(O::extract_key(*item->node()), hash);
+
+            if (unique && found_ctx.second) {
+                return false;
+            }
+
+            item_type* const adopted = adopt(item->node());
+
+            unlink();
+
+            if (adopted != item) {
+                drop(item->node());
+            }
+
+            link_order_(adopted, found_ctx.second ? found_ctx.first.item() : nullptr);
+            adopted->set_hash(hash);
+            push_item_(found_ctx.first, adopted, hash);
+            filter_().add(hash);
+            ++nitems_;
+            return true;
+        };
+
+        if (!unique) {
+            reserve(nitems_ + right.nitems_);
+        }
+
+        // right rehashes as it shrinks, which its order list survives
+        if constexpr (item_type::ordered) {
+            for (item_type* item = right.order_().head; item;) {
+                item_type* const next = item->after();
+                take(item, [&right, item](){ right.pop(item->node()); });
+                item = next;
+            }
+
+            return;
+        }
+
+        for (context_type ctx = first_ctx_<context_type>(&right), end_ctx = last_ctx_<context_type>(&right); ctx.ptr() != end_ctx.ptr();) {
+            if (!ctx_item_(ctx)) {
+                ctx = next_ctx_bucket_(ctx);
+            } else if (!take(ctx.item(), [&right, ctx](){ --right.nitems_; pop_item_(ctx); })) {
+                ctx = next_ctx_item_(ctx);
+            }
+        }
+
+        right.shrink_();
+    }
+
+    void splice(intrhash_t& right, bool unique) {
+        splice(right, unique, [](node_type* node){ return node; }, [](node_type*){});
+    }
+
+    // gen() is called on a miss only and returns the node to push, so it
+    // can build the node in place from what it captured
     template <class K, class F>
-    std::pair<iterator, bool> find_or_push_no_resize(const K& key, const F& gen) {
-        const auto found_ctx = find_ctx_(key);
+    std::pair<iterator, bool> find_or_push_no_resize(const K& key, size_t hash, F&& gen) {
+        const auto found_ctx = find_ctx_(key, hash);
 
         if (!found_ctx.second) {
-            push_item_(found_ctx.first, gen());
+            item_type* const item = gen();
+            item->set_hash(hash);
+            push_item_(found_ctx.first, item, hash);
+            link_order_(item, nullptr);
+            filter_().add(hash);
             ++nitems_;
             return {found_ctx.first.item(), true};
         }
@@ -752,9 +2239,20 @@ public:
     }
 
     template <class K, class F>
-    std::pair<iterator, bool> find_or_push(const K& key, const F& gen) {
-        resize(nitems_ + 1);
-        return find_or_push_no_resize(key, gen);
+    std::pair<iterator, bool> find_or_push_no_resize(const K& key, F&& gen) {
+        return find_or_push_no_resize(key, O::hash(key), std::forward<F>(gen));
+    }
+
+    template <class K, class F>
+    std::pair<iterator, bool> find_or_push(const K& key, size_t hash, F&& gen) {
+        grow_(nitems_ + 1);
+        return find_or_push_no_resize(key, hash, std::forward<F>(gen));
+    }
+
+    template <class K, class F>
+    std::pair<iterator, bool> find_or_push(const K& key, F&& gen) {
+        grow_(nitems_ + 1);
+        return find_or_push_no_resize(key, std::forward<F>(gen));
     }
 
 private:
@@ -767,9 +2265,11 @@ public:
     {}
 
     explicit intrhash_t(size_t n)
-        : buckets_(intrhash_priv::buckets_count(n) + 1, allocator_type())
+        : shape_(n)
+        , buckets_(shape_.size() + 1, allocator_type())
     {
         init_buckets_(&buckets_);
+        update_limits_();
     }
 
     explicit intrhash_t(const allocator_type& allocator)
@@ -778,14 +2278,15 @@ public:
 
     template <class X>
     explicit intrhash_t(size_t n, X&& allocator_param)
-        : buckets_(intrhash_priv::buckets_count(n) + 1, std::forward<X>(allocator_param))
+        : shape_(n)
+        , buckets_(shape_.size() + 1, std::forward<X>(allocator_param))
     {
         init_buckets_(&buckets_);
+        update_limits_();
     }
 
     intrhash_t(intrhash_t&& right) {
-        buckets_.swap(right.buckets_);
-        std::swap(nitems_, right.nitems_);
+        swap(right);
     }
 
     ~intrhash_t() noexcept {
@@ -794,8 +2295,21 @@ public:
 
 public:
     void swap(intrhash_t& right) noexcept {
+        std::swap(stats_(), right.stats_());
+        filter_().swap(right.filter_());
+        order_().swap(right.order_());
+        std::swap(shape_, right.shape_);
+        std::swap(old_shape_, right.old_shape_);
         buckets_.swap(right.buckets_);
+        old_buckets_.swap(right.old_buckets_);
+        std::swap(migrated_, right.migrated_);
+        std::swap(initialized_, right.initialized_);
+        std::swap(rehash_work_, right.rehash_work_);
         std::swap(nitems_, right.nitems_);
+        std::swap(max_items_, right.max_items_);
+        std::swap(min_items_, right.min_items_);
+        std::swap(max_load_, right.max_load_);
+        std::swap(min_load_, right.min_load_);
     }
 
     auto get_allocator() const noexcept -> decltype(intrhash_util::declret<buckets_type>().get_allocator()) {
@@ -805,33 +2319,85 @@ public:
 protected:
     template <class F>
     intrhash_t(const intrhash_t& right, F gen)
-        : buckets_(right.buckets_.size(), right.buckets_.get_allocator())
+        : filter_type(right.filter_())
+        , shape_(right.shape_)
+        , buckets_(right.buckets_.size(), right.buckets_.get_allocator())
         , nitems_(right.nitems_)
+        , max_items_(right.max_items_)
+        , min_items_(right.min_items_)
+        , max_load_(right.max_load_)
+        , min_load_(right.min_load_)
     {
         init_buckets_(&buckets_);
 
-        for (size_t i = 0; i != buckets_.size() - 1; ++i) {
+        // keeps the order of the list; a copy goes in front of an equal key
+        // already copied, as push() would put it
+        if constexpr (item_type::ordered) {
+            for (const item_type* item = right.order_().head; item; item = item->after()) {
+                item_type* const copy = copy_item_(item, gen);
+                const size_t hash = item_hash_(item);
+                const auto found_ctx = find_chain_ctx_(intrhash_nostats(), bucket_ctx_<context_type>(buckets_, shape_, hash), O::extract_key(*copy->node()), hash);
+
+                push_item_(found_ctx.first, copy, hash);
+                link_order_(copy, nullptr);
+            }
+
+            return;
+        }
+
+        for (size_t i = 0; i != (right.linked_() ? buckets_.size() - 1 : 0); ++i) {
             const_context_type ctx(&right.buckets_[i]);
             context_type ins(&buckets_[i]);
 
             while (!ctx_bucket_(ctx)) {
-                push_item_(ins, gen(ctx.node()));
+                push_tagged_item_(ins, copy_item_(ctx.item(), gen), ctx_tag_(ctx));
                 ctx = next_ctx_item_(ctx);
             }
         }
+
+        if (right.rehashing_()) {
+            for (size_t i = right.migrated_; i != right.old_buckets_.size() - 1; ++i) {
+                for (const_context_type ctx(&right.old_buckets_[i]); !ctx_bucket_(ctx); ctx = next_ctx_item_(ctx)) {
+                    const size_t hash = item_hash_(ctx.item());
+                    push_item_(bucket_ctx_<context_type>(buckets_, shape_, hash), copy_item_(ctx.item(), gen), hash);
+                }
+            }
+        }
     }
 
 private:
+    template <class F>
+    static item_type* copy_item_(const item_type* item, F& gen) {
+        item_type* const copy = gen(item->node());
+
+        if (item_type::cached_hash) {
+            copy->set_hash(item_hash_(item));
+        }
+
+        return copy;
+    }
+
+private:
+    shape_type shape_;
+    shape_type old_shape_;
     buckets_type buckets_;
+    buckets_type old_buckets_;
+    size_t migrated_ = 0;
+    size_t initialized_ = 0;
+    size_t rehash_work_ = P::rehash_step;
     size_t nitems_ = 0;
+    size_t max_items_ = 0;
+    size_t min_items_ = 0;
+    float max_load_ = P::max_load_factor;
+    float min_load_ = P::min_load_factor;
 };
 
-template <class T, class O, class D = intrhash_util::delete_ops, class A = std::allocator<T>>
+template <class T, class O, class D = intrhash_util::delete_ops, class A = std::allocator<T>, class P = generic_intrhash_policy>
 class ownintrhash_t
-    : public intrhash_t<T, O, A>
+    : public intrhash_t<T, O, A, P>
 {
 private:
-    using base_type = intrhash_t<T, O, A>;
+    using base_type = intrhash_t<T, O, A, P>;
 
     using item_type = typename base_type::item_type;
     using node_type = typename base_type::node_type;
@@ -861,9 +2427,9 @@ public:
     }
 
 public:
-    size_t erase(item_type* item) noexcept {
-        if (item = pop(item)) {
-            D::destroy(item);
+    size_t erase(node_type* node) noexcept {
+        if ((node = this->pop(node))) {
+            D::destroy(node);
             return 1;
         } else {
             return 0;
@@ -876,7 +2442,7 @@ public:
 
     template <class K>
     size_t erase(const K& key) noexcept {
-        if (node_type* const node = this->pop(key)) {
+        if (node_type* const node = this->pop_one(key)) {
             D::destroy(node);
             return 1;
         } else {
@@ -0,0 +1,289 @@
+#pragma once
+
+#include "intrhash.h"
+#include "nodeallc.h"
+
+// every entry costs one unit of capacity
+struct intrhash_lru_count {
+    template <class K, class V>
+    static size_t size(const K&, const V&) noexcept {
+        return 1;
+    }
+};
+
+// entries cost their own footprint; types owning heap memory need their own S
+struct intrhash_lru_bytes {
+    template <class K, class V>
+    static size_t size(const K&, const V&) noexcept {
+        return sizeof(K) + sizeof(V);
+    }
+};
+
+namespace intrhash_lru_priv {
+    template <class K, class V, class O, class A, class P>
+    struct impl {
+        using value_type = std::pair<const K, V>;
+
+        struct node_t
+            : public P::template item<node_t>
+        {
+            node_t(const K& key, const V& _value, size_t _size)
+                : value(key, _value)
+                , size(_size)
+            {}
+
+            value_type value;
+            size_t size;
+
+            // prev is the less recently used neighbour
+            node_t* prev = nullptr;
+            node_t* next = nullptr;
+        };
+
+        struct ops: public O {
+            static const K& extract_key(const node_t& node) noexcept {
+                return node.value.first;
+            }
+
+            static value_type& extract_value(node_t& node) noexcept {
+                return node.value;
+            }
+
+            static const value_type& extract_value(const node_t& node) noexcept {
+                return node.value;
+            }
+        };
+
+        using allc_type = nodeallc_t<node_t, A>;
+        using impl_type = intrhash_t<node_t, ops, A, P>;
+    };
+}
+
+// A cache bounded by the total S::size() of its entries. Each node carries
+// both the hash hook and the recency links, so get/put/evict are O(1) and
+// allocate nothing beyond the node; put() walks the chain once, links a new
+// entry and then evicts. The node of an evicted entry is kept as a spare that
+// the next new entry is built in, so a full cache does not go back to the
+// allocator.
+template <class K, class V, class O = generic_intrhash_ops, class S = intrhash_lru_count, class A = std::allocator<V>, class P = generic_intrhash_policy>
+class intrhash_lru_t
+    : private intrhash_lru_priv::impl<K, V, O, A, P>::allc_type
+    , private intrhash_lru_priv::impl<K, V, O, A, P>::impl_type
+{
+private:
+    using priv_impl = typename intrhash_lru_priv::impl<K, V, O, A, P>;
+
+    using allc_type = typename priv_impl::allc_type;
+    using impl_type = typename priv_impl::impl_type;
+
+    using node_type = typename impl_type::node_type;
+
+public:
+    using value_type = typename priv_impl::value_type;
+
+public:
+    using allc_type::get_allocator;
+
+    using impl_type::size;
+    using impl_type::empty;
+    using impl_type::has;
+
+    using impl_type::stats;
+
+public:
+    // promotes the entry to most recently used
+    template <class _K>
+    V* get(const _K& key) noexcept {
+        if (node_type* const node = this->find_ptr(key)) {
+            unlink_(node);
+            link_(node);
+            return &node->value.second;
+        }
+
+        return nullptr;
+    }
+
+    template <class _K>
+    const V* peek(const _K& key) const noexcept {
+        const node_type* const node = this->find_ptr(key);
+        return node ? &node->value.second : nullptr;
+    }
+
+    // evicts least recently used entries into cbk(value_type&) until the new
+    // one fits; false if the key was already there and got its value replaced,
+    // or if the entry is larger than the whole capacity and was not stored.
+    // The entry is linked before anything is evicted, so if cbk throws, it
+    // stays and the cache is over capacity until the next put()
+    template <class F>
+    bool put(const K& key, const V& value, F&& cbk) {
+        const size_t size = S::size(key, value);
+        node_type* fresh = nullptr;
+
+        if (size > capacity_ && !this->has(key)) {
+            return false;
+        }
+
+        const auto result = this->find_or_push(key, [this, &key, &value, size, &fresh](){
+            if (!spare_) {
+                return fresh = this->new_node(key, value, size);
+            }
+
+            fresh = new (spare_) node_type(key, value, size);
+            spare_ = nullptr;
+            return fresh;
+        });
+        node_type* const node = result.first.node();
+
+        if (node == fresh) {
+            used_ += size;
+            link_(node);
+        } else {
+            node->value.second = value;
+            used_ = used_ - node->size + size;
+            node->size = size;
+            unlink_(node);
+            link_(node);
+        }
+
+        evict_(cbk);
+        return node == fresh;
+    }
+
+    bool put(const K& key, const V& value) {
+        return put(key, value, [](value_type&){});
+    }
+
+    template <class _K>
+    size_t erase(const _K& key) noexcept {
+        if (node_type* const node = this->pop_one(key)) {
+            used_ -= node->size;
+            unlink_(node);
+            this->delete_node(node);
+            return 1;
+        }
+
+        return 0;
+    }
+
+    void clear() noexcept {
+        if (spare_) {
+            this->deallocate_node(spare_);
+            spare_ = nullptr;
+        }
+
+        if constexpr (allc_type::bulk_release) {
+            this->abandon();
+            this->release_nodes();
+        } else {
+            this->decompose([this](node_type* node){ this->delete_node(node); });
+        }
+
+        lru_ = mru_ = nullptr;
+        used_ = 0;
+    }
+
+public:
+    size_t capacity() const noexcept {
+        return capacity_;
+    }
+
+    // the total S::size() of all entries
+    size_t used() const noexcept {
+        return used_;
+    }
+
+    template <class F>
+    void set_capacity(size_t capacity, F&& cbk) {
+        capacity_ = capacity;
+        evict_(cbk);
+    }
+
+    void set_capacity(size_t capacity) {
+        set_capacity(capacity, [](value_type&){});
+    }
+
+private:
+    void link_(node_type* node) noexcept {
+        node->prev = mru_;
+        node->next = nullptr;
+
+        if (mru_) {
+            mru_->next = node;
+        } else {
+            lru_ = node;
+        }
+
+        mru_ = node;
+    }
+
+    void unlink_(node_type* node) noexcept {
+        if (node->prev) {
+            node->prev->next = node->next;
+        } else {
+            lru_ = node->next;
+        }
+
+        if (node->next) {
+            node->next->prev = node->prev;
+        } else {
+            mru_ = node->prev;
+        }
+    }
+
+    // hands least recently used entries to cbk and frees them, but for one
+    // node kept as the spare
+    template <class F>
+    void evict_(F& cbk) {
+        while (used_ > capacity_) {
+            node_type* const node = lru_;
+
+            this->pop(node);
+            unlink_(node);
+            used_ -= node->size;
+
+            try {
+                cbk(node->value);
+            } catch (...) {
+                this->delete_node(node);
+                throw;
+            }
+
+            if (spare_) {
+                this->delete_node(node);
+            } else {
+                node->~node_type();
+                spare_ = node;
+            }
+        }
+    }
+
+public:
+    explicit intrhash_lru_t(size_t capacity)
+        : capacity_(capacity)
+    {}
+
+    template <class X>
+    intrhash_lru_t(size_t capacity, X&& allocator_param)
+        : allc_type(std::forward<X>(allocator_param))
+        , impl_type(0, allc_type::get_allocator())
+        , capacity_(capacity)
+    {}
+
+    ~intrhash_lru_t() noexcept {
+        clear();
+    }
+
+private:
+    intrhash_lru_t(const intrhash_lru_t&) = delete;
+    intrhash_lru_t& operator=(const intrhash_lru_t&) = delete;
+
+private:
+    node_type* lru_ = nullptr;
+    node_type* mru_ = nullptr;
+
+    // raw storage of an evicted node, for the next new entry
+    node_type* spare_ = nullptr;
+
+    size_t capacity_;
+    size_t used_ = 0;
+};
@@ -1,17 +1,48 @@
 #pragma once
 
+#include <cstddef>
+#include <memory>
+#include <type_traits>
+#include <utility>
+
+namespace nodeallc_priv {
+    template <class A, class = void>
+    struct has_release_all: std::false_type {};
+
+    template <class A>
+    struct has_release_all<A, decltype(std::declval<A&>().release_all())>: std::true_type {};
+
+    template <class A, class = void>
+    struct has_reserve: std::false_type {};
+
+    template <class A>
+    struct has_reserve<A, decltype(std::declval<A&>().reserve(size_t()))>: std::true_type {};
+}
+
 template <class T, class A>
 class nodeallc_t {
 public:
     using node_type = T;
     using allocator_type = typename A::template rebind<node_type>::other;
 
+    // the owner may abandon its nodes and hand them back with release_nodes()
+    static constexpr bool bulk_release = nodeallc_priv::has_release_all<allocator_type>::value && std::is_trivially_destructible<node_type>::value;
+
     nodeallc_t() = default;
 
     nodeallc_t(const allocator_type& allocator)
         : allocator_(allocator)
     {}
 
+    // a copied table gets an allocator of its own, e.g. a new arena
+    nodeallc_t(const nodeallc_t& right)
+        : allocator_(std::allocator_traits<allocator_type>::select_on_container_copy_construction(right.allocator_))
+    {}
+
+    nodeallc_t(nodeallc_t&&) = default;
+    nodeallc_t& operator=(const nodeallc_t&) = default;
+    nodeallc_t& operator=(nodeallc_t&&) = default;
+
     void swap(nodeallc_t& right) noexcept {
         std::swap(allocator_, right.allocator_);
     }
@@ -42,6 +73,50 @@ public:
         deallocate_node(node);
     }
 
+    // readies n nodes at once where the allocator can, e.g. from one chunk
+    void reserve_nodes(size_t n) {
+        if constexpr (nodeallc_priv::has_reserve<allocator_type>::value) {
+            allocator_.reserve(n);
+        }
+    }
+
+    // frees every node allocated so far at once, but those of handles made by
+    // make_handle(); needs bulk_release
+    void release_nodes() noexcept {
+        allocator_.release_all();
+    }
+
+    // node of right to be freed by this allocator: the node itself if the two
+    // allocators are equal, or else a new one it is moved into. right still
+    // owns node either way, and if this throws, nothing has changed hands
+    node_type* adopt_node(node_type* node, const nodeallc_t& right) {
+        if (allocator_ == right.allocator_) {
+            return node;
+        }
+
+        return new_node(std::move(*node));
+    }
+
+    // the handle shares this allocator, so with bulk_release the arena stays
+    // alive for it and release_nodes() starts a new one
+    template <class H>
+    H make_handle(node_type* node) {
+        return node ? H(node, allocator_) : H();
+    }
+
+    // empties the handle, unless adopting its node throws
+    template <class H>
+    node_type* adopt_node(H& handle) {
+        node_type* const node = adopt_node(handle.node_, handle.allc_);
+
+        if (node != handle.node_) {
+            handle.allc_.delete_node(handle.node_);
+        }
+
+        handle.node_ = nullptr;
+        return node;
+    }
+
 public:
     const allocator_type& get_allocator() const noexcept {
         return allocator_;
@@ -50,3 +125,69 @@ public:
 private:
     allocator_type allocator_;
 };
+
+// owns a node taken out of a table, along with the allocator that frees it
+template <class T, class A>
+class nodeallc_handle_t {
+    template <class, class> friend class nodeallc_t;
+
+public:
+    using node_type = T;
+    using allocator_type = typename nodeallc_t<T, A>::allocator_type;
+
+public:
+    nodeallc_handle_t() = default;
+
+    nodeallc_handle_t(node_type* node, const allocator_type& allocator)
+        : allc_(allocator)
+        , node_(node)
+    {}
+
+    nodeallc_handle_t(nodeallc_handle_t&& right) noexcept
+        : allc_(std::move(right.allc_))
+        , node_(right.node_)
+    {
+        right.node_ = nullptr;
+    }
+
+    nodeallc_handle_t& operator=(nodeallc_handle_t&& right) noexcept {
+        nodeallc_handle_t(std::move(right)).swap(*this);
+        return *this;
+    }
+
+    ~nodeallc_handle_t() noexcept {
+        if (node_) {
+            allc_.delete_node(node_);
+        }
+    }
+
+    void swap(nodeallc_handle_t& right) noexcept {
+        allc_.swap(right.allc_);
+        std::swap(node_, right.node_);
+    }
+
+public:
+    bool empty() const noexcept {
+        return !node_;
+    }
+
+    explicit operator bool() const noexcept {
+        return node_;
+    }
+
+    node_type* get() const noexcept {
+        return node_;
+    }
+
+    const allocator_type& get_allocator() const noexcept {
+        return allc_.get_allocator();
+    }
+
+private:
+    nodeallc_handle_t(const nodeallc_handle_t&) = delete;
+    nodeallc_handle_t& operator=(const nodeallc_handle_t&) = delete;
+
+private:
+    nodeallc_t<T, A> allc_;
+    node_type* node_ = nullptr;
+};
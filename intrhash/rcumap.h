@@ -0,0 +1,307 @@
+#pragma once
+
+#include "intrhash.h"
+#include "nodeallc.h"
+#include "epoch.h"
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace intrhash_rcu_priv {
+    template <class K, class T>
+    struct node_t {
+        using value_type = std::pair<const K, T>;
+
+        node_t(const value_type& _value, size_t _hash)
+            : value(_value)
+            , hash(_hash)
+        {}
+
+        value_type value;
+        const size_t hash;
+
+        // one link per table generation, so that a resize builds the new
+        // chains without touching the ones readers may still be walking
+        std::atomic<node_t*> next[2] = {{nullptr}, {nullptr}};
+    };
+}
+
+// find/has are wait-free; writers are serialized by a mutex and retire
+// unlinked nodes and tables through intrhash_epoch_t, without waiting for
+// readers. A resize rewrites the links of the table before the current one,
+// so it is put off, and chains run longer, while any reader in the process
+// entered before that table was retired; a find() callback may write.
+// Only P::buckets and P::max_load_factor apply to this table.
+template <class K, class T, class O = generic_intrhash_ops, class A = std::allocator<T>, class P = generic_intrhash_policy>
+class rcu_intrhash_map_t
+    : private nodeallc_t<intrhash_rcu_priv::node_t<K, T>, A>
+{
+private:
+    using node_type = intrhash_rcu_priv::node_t<K, T>;
+    using allc_type = nodeallc_t<node_type, A>;
+    using shape_type = typename P::buckets;
+    using link_type = std::atomic<node_type*>;
+
+    struct table_t {
+        table_t(size_t n, unsigned _parity)
+            : shape(n)
+            , parity(_parity)
+            , buckets(new link_type[shape.size()])
+        {
+            for (size_t i = 0; i != shape.size(); ++i) {
+                buckets[i].store(nullptr, std::memory_order_relaxed);
+            }
+        }
+
+        link_type& bucket(size_t hash) const noexcept {
+            return buckets[shape.index(hash)];
+        }
+
+        const shape_type shape;
+        const unsigned parity;
+        const std::unique_ptr<link_type[]> buckets;
+    };
+
+public:
+    using value_type = typename node_type::value_type;
+
+public:
+    template <class _K, class F>
+    bool find(const _K& key, F&& cbk) const {
+        const size_t hash = O::hash(key);
+        intrhash_epoch_t::guard_t guard;
+        const table_t* const table = table_.load(std::memory_order_acquire);
+
+        for (const node_type* node = table->bucket(hash).load(std::memory_order_acquire); node; node = node->next[table->parity].load(std::memory_order_acquire)) {
+            if (node->hash == hash && O::equal_to(node->value.first, key)) {
+                cbk(node->value);
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    template <class _K>
+    bool has(const _K& key) const {
+        return find(key, [](const value_type&){});
+    }
+
+    size_t size() const noexcept {
+        return nitems_.load(std::memory_order_relaxed);
+    }
+
+    bool empty() const noexcept {
+        return !size();
+    }
+
+public:
+    bool insert(const value_type& value) {
+        const size_t hash = O::hash(value.first);
+        std::lock_guard<std::mutex> guard(lock_);
+
+        if (*find_link_(value.first, hash)) {
+            return false;
+        }
+
+        grow_(size() + 1);
+        link_(this->new_node(value, hash));
+        return true;
+    }
+
+    // replaces the node rather than the value, so readers never see a torn value
+    bool insert_or_assign(const value_type& value) {
+        const size_t hash = O::hash(value.first);
+        std::lock_guard<std::mutex> guard(lock_);
+        link_type* const link = find_link_(value.first, hash);
+
+        if (node_type* const node = link->load(std::memory_order_relaxed)) {
+            const unsigned parity = table_.load(std::memory_order_relaxed)->parity;
+            node_type* const copy = this->new_node(value, hash);
+
+            copy->next[parity].store(node->next[parity].load(std::memory_order_relaxed), std::memory_order_relaxed);
+            link->store(copy, std::memory_order_release);
+            retire_(node);
+            return false;
+        }
+
+        grow_(size() + 1);
+        link_(this->new_node(value, hash));
+        return true;
+    }
+
+    template <class _K>
+    size_t erase(const _K& key) {
+        const size_t hash = O::hash(key);
+        std::lock_guard<std::mutex> guard(lock_);
+        link_type* const link = find_link_(key, hash);
+
+        if (node_type* const node = link->load(std::memory_order_relaxed)) {
+            link->store(node->next[table_.load(std::memory_order_relaxed)->parity].load(std::memory_order_relaxed), std::memory_order_release);
+            nitems_.store(size() - 1, std::memory_order_relaxed);
+            retire_(node);
+            return 1;
+        }
+
+        return 0;
+    }
+
+    void clear() {
+        std::lock_guard<std::mutex> guard(lock_);
+        const table_t* const table = table_.load(std::memory_order_relaxed);
+
+        for (size_t i = 0; i != table->shape.size(); ++i) {
+            node_type* node = table->buckets[i].load(std::memory_order_relaxed);
+            table->buckets[i].store(nullptr, std::memory_order_release);
+
+            while (node) {
+                node_type* const next = node->next[table->parity].load(std::memory_order_relaxed);
+                retire_(node);
+                node = next;
+            }
+        }
+
+        nitems_.store(0, std::memory_order_relaxed);
+    }
+
+private:
+    template <class _K>
+    link_type* find_link_(const _K& key, size_t hash) const noexcept {
+        const table_t* const table = table_.load(std::memory_order_relaxed);
+        link_type* link = &table->bucket(hash);
+
+        for (node_type* node; (node = link->load(std::memory_order_relaxed)); link = &node->next[table->parity]) {
+            if (node->hash == hash && O::equal_to(node->value.first, key)) {
+                break;
+            }
+        }
+
+        return link;
+    }
+
+    void link_(node_type* node) noexcept {
+        const table_t* const table = table_.load(std::memory_order_relaxed);
+        link_type& bucket = table->bucket(node->hash);
+
+        node->next[table->parity].store(bucket.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        bucket.store(node, std::memory_order_release);
+        nitems_.store(size() + 1, std::memory_order_relaxed);
+    }
+
+    void grow_(size_t n) {
+        const table_t* const old = table_.load(std::memory_order_relaxed);
+
+        if (n <= static_cast<size_t>(static_cast<double>(old->shape.size()) * P::max_load_factor)) {
+            return;
+        }
+
+        // readers of the table before the old one walk the links about to be
+        // rewritten; the next insert tries again
+        if (!retired_tables_.empty()) {
+            collect_();
+
+            if (!retired_tables_.empty()) {
+                return;
+            }
+        }
+
+        std::unique_ptr<table_t> table(new table_t(static_cast<size_t>(n / P::max_load_factor) + 1, old->parity ^ 1));
+
+        if (table->shape.size() <= old->shape.size()) {
+            return;
+        }
+
+        for (size_t i = 0; i != old->shape.size(); ++i) {
+            for (node_type* node = old->buckets[i].load(std::memory_order_relaxed); node; node = node->next[old->parity].load(std::memory_order_relaxed)) {
+                link_type& bucket = table->bucket(node->hash);
+                node->next[table->parity].store(bucket.load(std::memory_order_relaxed), std::memory_order_relaxed);
+                bucket.store(node, std::memory_order_relaxed);
+            }
+        }
+
+        table_.store(table.release(), std::memory_order_release);
+        retired_tables_.emplace_back(intrhash_epoch_t::instance().retire(), old);
+    }
+
+    void retire_(node_type* node) {
+        retired_nodes_.emplace_back(intrhash_epoch_t::instance().retire(), node);
+
+        if (retired_nodes_.size() >= collect_threshold_) {
+            collect_();
+        }
+    }
+
+    void collect_() noexcept {
+        const uint64_t min_active = intrhash_epoch_t::instance().min_active();
+
+        auto node = retired_nodes_.begin();
+
+        for (; node != retired_nodes_.end() && node->first < min_active; ++node) {
+            this->delete_node(node->second);
+        }
+
+        retired_nodes_.erase(retired_nodes_.begin(), node);
+
+        auto table = retired_tables_.begin();
+
+        for (; table != retired_tables_.end() && table->first < min_active; ++table) {
+            delete table->second;
+        }
+
+        retired_tables_.erase(retired_tables_.begin(), table);
+    }
+
+    static constexpr size_t collect_threshold_ = 64;
+
+public:
+    rcu_intrhash_map_t()
+        : rcu_intrhash_map_t(0)
+    {}
+
+    explicit rcu_intrhash_map_t(size_t n)
+        : table_(new table_t(n, 0))
+    {}
+
+    template <class X>
+    explicit rcu_intrhash_map_t(size_t n, X&& allocator_param)
+        : allc_type(std::forward<X>(allocator_param))
+        , table_(new table_t(n, 0))
+    {}
+
+    // no reader may be running when the table is destroyed
+    ~rcu_intrhash_map_t() noexcept {
+        const table_t* const table = table_.load(std::memory_order_relaxed);
+
+        for (size_t i = 0; i != table->shape.size(); ++i) {
+            for (node_type* node = table->buckets[i].load(std::memory_order_relaxed); node;) {
+                node_type* const next = node->next[table->parity].load(std::memory_order_relaxed);
+                this->delete_node(node);
+                node = next;
+            }
+        }
+
+        for (const auto& node : retired_nodes_) {
+            this->delete_node(node.second);
+        }
+
+        for (const auto& retired : retired_tables_) {
+            delete retired.second;
+        }
+
+        delete table;
+    }
+
+private:
+    rcu_intrhash_map_t(const rcu_intrhash_map_t&) = delete;
+    rcu_intrhash_map_t& operator=(const rcu_intrhash_map_t&) = delete;
+
+private:
+    std::atomic<table_t*> table_;
+    std::atomic<size_t> nitems_{0};
+
+    std::mutex lock_;
+    std::vector<std::pair<uint64_t, node_type*>> retired_nodes_;
+    std::vector<std::pair<uint64_t, const table_t*>> retired_tables_;
+};
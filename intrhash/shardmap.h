@@ -0,0 +1,192 @@
+#pragma once
+
+#include "hashmap.h"
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <type_traits>
+
+namespace intrhash_util {
+    class spin_lock {
+    public:
+        void lock() noexcept {
+            while (locked_.exchange(true, std::memory_order_acquire)) {
+                while (locked_.load(std::memory_order_relaxed)) {
+#if defined(__i386__) || defined(__x86_64__)
+                    __builtin_ia32_pause();
+#endif
+                }
+            }
+        }
+
+        bool try_lock() noexcept {
+            return !locked_.load(std::memory_order_relaxed) && !locked_.exchange(true, std::memory_order_acquire);
+        }
+
+        void unlock() noexcept {
+            locked_.store(false, std::memory_order_release);
+        }
+
+        void lock_shared() noexcept {
+            lock();
+        }
+
+        void unlock_shared() noexcept {
+            unlock();
+        }
+
+    private:
+        std::atomic<bool> locked_{false};
+    };
+}
+
+// Keys are spread over a power of two number of independently locked maps by
+// the top bits of the remixed hash. Values are only reachable from callbacks
+// run under the shard lock, so no reference outlives it.
+template <class K, class T, class O = generic_intrhash_ops, class A = std::allocator<T>, class P = generic_intrhash_policy, class L = std::shared_mutex>
+class sharded_intrhash_map_t {
+private:
+    using map_type = intrhash_map_t<K, T, O, A, P>;
+    using lock_type = L;
+
+    static_assert(std::is_same<typename P::stats, intrhash_nostats>::value, "readers share a shard lock, under which stats counters would race");
+
+    struct alignas(64) shard_t {
+        mutable lock_type lock;
+        map_type map;
+    };
+
+public:
+    using value_type = typename map_type::value_type;
+
+private:
+    // the hash that picked the shard is handed on to its map, so the bits
+    // picking the shard must not be the ones picking the bucket: the top bits
+    // of hash * 0x9e3779b97f4a7c15 are pow2_intrhash_buckets' index, and would
+    // leave each shard's map all but 1/nshards of its buckets empty
+    shard_t& shard_(size_t hash) const noexcept {
+        const uint64_t value = static_cast<uint64_t>(hash);
+        return shards_[(value ^ (value >> 29)) * 0xbf58476d1ce4e5b9ull >> shift_];
+    }
+
+public:
+    template <class _K, class F>
+    bool find(const _K& key, F&& cbk) const {
+        const size_t hash = O::hash(key);
+        shard_t& shard = shard_(hash);
+        std::shared_lock<lock_type> guard(shard.lock);
+        const auto iter = static_cast<const map_type&>(shard.map).find(key, hash);
+
+        if (iter != shard.map.end()) {
+            cbk(*iter);
+            return true;
+        }
+
+        return false;
+    }
+
+    template <class _K, class F>
+    bool modify(const _K& key, F&& cbk) {
+        const size_t hash = O::hash(key);
+        shard_t& shard = shard_(hash);
+        std::lock_guard<lock_type> guard(shard.lock);
+        const auto iter = shard.map.find(key, hash);
+
+        if (iter != shard.map.end()) {
+            cbk(*iter);
+            return true;
+        }
+
+        return false;
+    }
+
+    template <class _K>
+    bool has(const _K& key) const {
+        const size_t hash = O::hash(key);
+        shard_t& shard = shard_(hash);
+        std::shared_lock<lock_type> guard(shard.lock);
+        return shard.map.has(key, hash);
+    }
+
+    bool insert(const value_type& value) {
+        const size_t hash = O::hash(value.first);
+        shard_t& shard = shard_(hash);
+        std::lock_guard<lock_type> guard(shard.lock);
+        return shard.map.insert(value, hash).second;
+    }
+
+    // runs cbk on the value of key, default-constructing it first if missing
+    template <class _K, class F>
+    bool find_or_push(const _K& key, F&& cbk) {
+        const size_t hash = O::hash(key);
+        shard_t& shard = shard_(hash);
+        std::lock_guard<lock_type> guard(shard.lock);
+        const auto result = shard.map.try_emplace_hashed(key, hash);
+
+        cbk(*result.first);
+        return result.second;
+    }
+
+    template <class _K>
+    size_t erase(const _K& key) {
+        const size_t hash = O::hash(key);
+        shard_t& shard = shard_(hash);
+        std::lock_guard<lock_type> guard(shard.lock);
+        return shard.map.erase(key, hash);
+    }
+
+    // visits every value shard by shard; each shard is locked while it is visited
+    template <class F>
+    void for_each(F&& cbk) const {
+        for (size_t i = 0; i != nshards(); ++i) {
+            std::shared_lock<lock_type> guard(shards_[i].lock);
+
+            for (const value_type& value : shards_[i].map) {
+                cbk(value);
+            }
+        }
+    }
+
+    void clear() {
+        for (size_t i = 0; i != nshards(); ++i) {
+            std::lock_guard<lock_type> guard(shards_[i].lock);
+            shards_[i].map.clear();
+        }
+    }
+
+    size_t size() const {
+        size_t result = 0;
+
+        for (size_t i = 0; i != nshards(); ++i) {
+            std::shared_lock<lock_type> guard(shards_[i].lock);
+            result += shards_[i].map.size();
+        }
+
+        return result;
+    }
+
+    size_t nshards() const noexcept {
+        return size_t(1) << (64 - shift_);
+    }
+
+public:
+    explicit sharded_intrhash_map_t(size_t n = 64)
+        : shift_(63)
+    {
+        while (shift_ > 48 && nshards() < n) {
+            --shift_;
+        }
+
+        shards_.reset(new shard_t[nshards()]);
+    }
+
+private:
+    sharded_intrhash_map_t(const sharded_intrhash_map_t&) = delete;
+    sharded_intrhash_map_t& operator=(const sharded_intrhash_map_t&) = delete;
+
+private:
+    unsigned shift_;
+    std::unique_ptr<shard_t[]> shards_;
+};
@@ -0,0 +1,205 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <type_traits>
+
+namespace intrhash_slab_priv {
+    // fixed size slots carved from chunks that double up to max_chunk_size;
+    // freed slots go on an intrusive list, handed out once the current chunk
+    // is used up and before a new one is allocated
+    class arena_t {
+    public:
+        explicit arena_t(size_t slot_size) noexcept
+            : slot_size_(std::max(slot_size, sizeof(void*)))
+        {}
+
+        ~arena_t() noexcept {
+            release();
+        }
+
+        void* allocate() {
+            if (first_ == last_) {
+                if (free_) {
+                    void* const slot = free_;
+                    free_ = *static_cast<void**>(slot);
+                    return slot;
+                }
+
+                grow_();
+            }
+
+            void* const slot = first_;
+            first_ += slot_size_;
+            return slot;
+        }
+
+        void deallocate(void* slot) noexcept {
+            *static_cast<void**>(slot) = free_;
+            free_ = slot;
+        }
+
+        // the next n allocations come from one chunk: the current one if it has
+        // n slots left, or else a new one of exactly n slots, in which case
+        // the leftover of the current one joins the free list for later
+        void reserve(size_t n) {
+            if (static_cast<size_t>(last_ - first_) / slot_size_ >= n) {
+                return;
+            }
+
+            chunk_t* const chunk = static_cast<chunk_t*>(::operator new(sizeof(chunk_t) + n * slot_size_));
+
+            for (; first_ != last_; first_ += slot_size_) {
+                deallocate(first_);
+            }
+
+            link_(chunk, n);
+        }
+
+        // every slot at once, whether freed or not
+        void release() noexcept {
+            while (chunks_) {
+                chunk_t* const chunk = chunks_;
+                chunks_ = chunk->next;
+                ::operator delete(chunk);
+            }
+
+            free_ = nullptr;
+            first_ = last_ = nullptr;
+            chunk_size_ = min_chunk_size_;
+        }
+
+    private:
+        struct alignas(std::max_align_t) chunk_t {
+            chunk_t* next;
+        };
+
+        void grow_() {
+            const size_t nslots = std::max<size_t>((chunk_size_ - sizeof(chunk_t)) / slot_size_, 1);
+            chunk_t* const chunk = static_cast<chunk_t*>(::operator new(sizeof(chunk_t) + nslots * slot_size_));
+
+            link_(chunk, nslots);
+            chunk_size_ = std::min(chunk_size_ * 2, max_chunk_size_);
+        }
+
+        void link_(chunk_t* chunk, size_t nslots) noexcept {
+            chunk->next = chunks_;
+            chunks_ = chunk;
+            first_ = reinterpret_cast<char*>(chunk + 1);
+            last_ = first_ + nslots * slot_size_;
+        }
+
+        static constexpr size_t min_chunk_size_ = size_t(1) << 12;
+        static constexpr size_t max_chunk_size_ = size_t(1) << 20;
+
+        const size_t slot_size_;
+        size_t chunk_size_ = min_chunk_size_;
+
+        chunk_t* chunks_ = nullptr;
+        void* free_ = nullptr;
+        char* first_ = nullptr;
+        char* last_ = nullptr;
+    };
+}
+
+// An allocator for the A parameter of the intrhash containers. Single objects
+// come from an arena that copies of the allocator share, while a copy made for
+// a container copy or a rebind to another type starts an arena of its own, so
+// every table owns its nodes. Arrays, such as bucket arrays, go to operator new.
+// nodeallc_t sees release_all(): a table of trivially destructible nodes then
+// frees them all in clear() without visiting them. It also sees reserve(n): the
+// nodes of a bulk insert, or of each run of a snapshot load, then come from one
+// chunk of n slots, while slots freed before wait for later inserts.
+template <class T>
+class intrhash_slab_allocator {
+    template <class> friend class intrhash_slab_allocator;
+
+public:
+    using value_type = T;
+    using pointer = T*;
+    using const_pointer = const T*;
+    using reference = T&;
+    using const_reference = const T&;
+    using size_type = size_t;
+    using difference_type = ptrdiff_t;
+
+    using propagate_on_container_copy_assignment = std::false_type;
+    using propagate_on_container_move_assignment = std::true_type;
+    using propagate_on_container_swap = std::true_type;
+
+    template <class U>
+    struct rebind {
+        using other = intrhash_slab_allocator<U>;
+    };
+
+public:
+    intrhash_slab_allocator() noexcept = default;
+
+    template <class U>
+    intrhash_slab_allocator(const intrhash_slab_allocator<U>&) noexcept {
+    }
+
+    intrhash_slab_allocator select_on_container_copy_construction() const noexcept {
+        return intrhash_slab_allocator();
+    }
+
+public:
+    T* allocate(size_t n) {
+        if (n != 1) {
+            return static_cast<T*>(::operator new(n * sizeof(T)));
+        }
+
+        return static_cast<T*>(arena_for_().allocate());
+    }
+
+    // room for the next n single objects in one chunk, as for a bulk insert
+    void reserve(size_t n) {
+        arena_for_().reserve(n);
+    }
+
+    void deallocate(T* ptr, size_t n) noexcept {
+        if (n != 1) {
+            ::operator delete(ptr);
+        } else {
+            arena_->deallocate(ptr);
+        }
+    }
+
+    // frees every single object this arena handed out; none may be used after.
+    // While other copies share the arena, such as those of node handles, it is
+    // left for them to free and this copy starts a new one
+    void release_all() noexcept {
+        if (arena_.use_count() > 1) {
+            arena_.reset();
+        } else if (arena_) {
+            arena_->release();
+        }
+    }
+
+public:
+    template <class U>
+    bool operator==(const intrhash_slab_allocator<U>& right) const noexcept {
+        return arena_ == right.arena_;
+    }
+
+    template <class U>
+    bool operator!=(const intrhash_slab_allocator<U>& right) const noexcept {
+        return arena_ != right.arena_;
+    }
+
+private:
+    intrhash_slab_priv::arena_t& arena_for_() {
+        static_assert(alignof(T) <= alignof(std::max_align_t), "over-aligned types are not supported");
+
+        if (!arena_) {
+            arena_ = std::make_shared<intrhash_slab_priv::arena_t>((sizeof(T) + alignof(T) - 1) / alignof(T) * alignof(T));
+        }
+
+        return *arena_;
+    }
+
+private:
+    std::shared_ptr<intrhash_slab_priv::arena_t> arena_;
+};
@@ -0,0 +1,359 @@
+#pragma once
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <istream>
+#include <limits>
+#include <memory>
+#include <ostream>
+#include <stdexcept>
+#include <system_error>
+#include <type_traits>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/stat.h>
+#include <unistd.h>
+#define INTRHASH_SNAPSHOT_FD 1
+#endif
+
+// field serializer for trivially copyable types: their bytes, native order
+struct intrhash_snapshot_raw {
+    template <class W, class X>
+    static void save(W& writer, const X& value) {
+        static_assert(std::is_trivially_copyable<X>::value, "intrhash_snapshot_raw needs trivially copyable fields");
+        writer.write(&value, sizeof(value));
+    }
+
+    template <class R, class X>
+    static void load(R& reader, X& value) {
+        static_assert(std::is_trivially_copyable<X>::value, "intrhash_snapshot_raw needs trivially copyable fields");
+        reader.read(&value, sizeof(value));
+    }
+};
+
+// Snapshot layout: header_t, then the fields of every element as written by
+// the serializer, in iteration order. A load checks the header, presizes the
+// table for as many of nitems as the stream can hold and links the elements
+// without looking them up.
+namespace intrhash_snapshot_priv {
+    constexpr char magic[8] = {'i', 'n', 't', 'r', 'h', 's', 's', '\1'};
+    constexpr uint32_t version = 1;
+
+    // bytes left in a source that cannot tell
+    constexpr size_t unknown_size = std::numeric_limits<size_t>::max();
+
+    // 0 sizes for a set's values
+    struct header_t {
+        char magic[8];
+        uint32_t version;
+        uint32_t key_size;
+        uint32_t value_size;
+        uint32_t reserved;
+        uint64_t nitems;
+    };
+
+    class ostream_sink {
+    public:
+        explicit ostream_sink(std::ostream& out) noexcept
+            : out_(out)
+        {}
+
+        void put(const char* data, size_t size) {
+            if (!out_.write(data, static_cast<std::streamsize>(size))) {
+                throw std::runtime_error("intrhash snapshot: write failed");
+            }
+        }
+
+    private:
+        std::ostream& out_;
+    };
+
+    // streams buffer on their own, so reading stops right after the snapshot
+    class istream_source {
+    public:
+        static constexpr bool buffered = true;
+
+        explicit istream_source(std::istream& in) noexcept
+            : in_(in)
+        {}
+
+        size_t get(char* data, size_t size) {
+            in_.read(data, static_cast<std::streamsize>(size));
+            return static_cast<size_t>(in_.gcount());
+        }
+
+        size_t available() {
+            const std::istream::pos_type pos = in_.tellg();
+
+            if (pos < 0 || !in_.seekg(0, std::ios::end)) {
+                in_.clear();
+                return unknown_size;
+            }
+
+            const std::istream::pos_type end = in_.tellg();
+            in_.seekg(pos);
+            return end >= pos ? static_cast<size_t>(end - pos) : unknown_size;
+        }
+
+        void unread(size_t) noexcept {
+        }
+
+    private:
+        std::istream& in_;
+    };
+
+    inline ostream_sink make_sink(std::ostream& out) noexcept {
+        return ostream_sink(out);
+    }
+
+    inline istream_source make_source(std::istream& in) noexcept {
+        return istream_source(in);
+    }
+
+#if defined(INTRHASH_SNAPSHOT_FD)
+    class fd_sink {
+    public:
+        explicit fd_sink(int fd) noexcept
+            : fd_(fd)
+        {}
+
+        void put(const char* data, size_t size) {
+            while (size) {
+                const ssize_t n = ::write(fd_, data, size);
+
+                if (n < 0) {
+                    if (errno == EINTR) {
+                        continue;
+                    }
+
+                    throw std::system_error(errno, std::generic_category(), "intrhash snapshot");
+                }
+
+                data += n;
+                size -= static_cast<size_t>(n);
+            }
+        }
+
+    private:
+        int fd_;
+    };
+
+    // reads ahead in large blocks, possibly past the end of the snapshot; a
+    // seekable fd is put back right after it once the load is done
+    class fd_source {
+    public:
+        static constexpr bool buffered = false;
+
+        explicit fd_source(int fd) noexcept
+            : fd_(fd)
+        {}
+
+        size_t get(char* data, size_t size) {
+            size_t result = 0;
+
+            while (result != size) {
+                const ssize_t n = ::read(fd_, data + result, size - result);
+
+                if (n < 0) {
+                    if (errno == EINTR) {
+                        continue;
+                    }
+
+                    throw std::system_error(errno, std::generic_category(), "intrhash snapshot");
+                }
+
+                if (!n) {
+                    break;
+                }
+
+                result += static_cast<size_t>(n);
+            }
+
+            return result;
+        }
+
+        size_t available() noexcept {
+            struct stat st;
+            const off_t pos = ::lseek(fd_, 0, SEEK_CUR);
+
+            if (pos < 0 || ::fstat(fd_, &st) != 0 || !S_ISREG(st.st_mode)) {
+                return unknown_size;
+            }
+
+            return st.st_size >= pos ? static_cast<size_t>(st.st_size - pos) : 0;
+        }
+
+        void unread(size_t size) noexcept {
+            if (size) {
+                ::lseek(fd_, -static_cast<off_t>(size), SEEK_CUR);
+            }
+        }
+
+    private:
+        int fd_;
+    };
+
+    inline fd_sink make_sink(int fd) noexcept {
+        return fd_sink(fd);
+    }
+
+    inline fd_source make_source(int fd) noexcept {
+        return fd_source(fd);
+    }
+#endif
+
+    constexpr size_t buffer_size = size_t(1) << 20;
+
+    // serializers write fields of a few bytes; they go through one large buffer
+    template <class X>
+    class writer_t {
+    public:
+        explicit writer_t(X sink)
+            : sink_(sink)
+            , buffer_(new char[buffer_size])
+        {}
+
+        void write(const void* data, size_t size) {
+            if (size > buffer_size - used_) {
+                flush();
+
+                if (size > buffer_size) {
+                    sink_.put(static_cast<const char*>(data), size);
+                    return;
+                }
+            }
+
+            std::memcpy(buffer_.get() + used_, data, size);
+            used_ += size;
+        }
+
+        void flush() {
+            sink_.put(buffer_.get(), used_);
+            used_ = 0;
+        }
+
+    private:
+        X sink_;
+        std::unique_ptr<char[]> buffer_;
+        size_t used_ = 0;
+    };
+
+    template <class X>
+    class reader_t {
+    public:
+        explicit reader_t(X source)
+            : source_(source)
+            , buffer_(X::buffered ? nullptr : new char[buffer_size])
+        {}
+
+        void read(void* data, size_t size) {
+            char* out = static_cast<char*>(data);
+
+            if (X::buffered) {
+                if (source_.get(out, size) != size) {
+                    throw std::runtime_error("intrhash snapshot: truncated");
+                }
+
+                return;
+            }
+
+            while (size) {
+                if (first_ == last_) {
+                    first_ = 0;
+                    last_ = source_.get(buffer_.get(), buffer_size);
+
+                    if (!last_) {
+                        throw std::runtime_error("intrhash snapshot: truncated");
+                    }
+                }
+
+                const size_t n = std::min(size, last_ - first_);
+                std::memcpy(out, buffer_.get() + first_, n);
+                first_ += n;
+                out += n;
+                size -= n;
+            }
+        }
+
+        // bytes left to read, read ahead included
+        size_t available() {
+            const size_t size = source_.available();
+            return size == unknown_size ? size : size + (last_ - first_);
+        }
+
+        // hands what was read ahead back to the source, where it can take it
+        void finish() noexcept {
+            source_.unread(last_ - first_);
+            first_ = last_ = 0;
+        }
+
+    private:
+        X source_;
+        std::unique_ptr<char[]> buffer_;
+        size_t first_ = 0;
+        size_t last_ = 0;
+    };
+
+    // cbk(writer, element) writes the fields of each element
+    template <class X, class I, class F>
+    void save(X&& to, size_t nitems, size_t key_size, size_t value_size, I first, I last, F&& cbk) {
+        writer_t<decltype(make_sink(to))> writer(make_sink(to));
+        header_t header;
+
+        std::memset(&header, 0, sizeof(header));
+        std::memcpy(header.magic, magic, sizeof(magic));
+        header.version = version;
+        header.key_size = static_cast<uint32_t>(key_size);
+        header.value_size = static_cast<uint32_t>(value_size);
+        header.nitems = nitems;
+
+        writer.write(&header, sizeof(header));
+
+        for (; first != last; ++first) {
+            cbk(writer, *first);
+        }
+
+        writer.flush();
+    }
+
+    // reserve(n) before each run of n elements, then cbk(reader) reads and
+    // links each one. nitems is not trusted for more than the stream can hold,
+    // at key_size + value_size bytes an element; past that, or if the stream
+    // cannot tell, the runs start at 1024 elements and double
+    template <class X, class G, class F>
+    void load(X&& from, size_t key_size, size_t value_size, G&& reserve, F&& cbk) {
+        reader_t<decltype(make_source(from))> reader(make_source(from));
+        header_t header;
+
+        reader.read(&header, sizeof(header));
+
+        if (std::memcmp(header.magic, magic, sizeof(magic)) != 0 || header.version != version) {
+            throw std::runtime_error("intrhash snapshot: not a snapshot");
+        }
+
+        if (header.key_size != key_size || header.value_size != value_size) {
+            throw std::runtime_error("intrhash snapshot: written for other types");
+        }
+
+        const size_t available = reader.available();
+        uint64_t reserved = available == unknown_size ? 0 : std::min<uint64_t>(header.nitems, available / std::max<size_t>(key_size + value_size, 1));
+
+        if (reserved) {
+            reserve(static_cast<size_t>(reserved));
+        }
+
+        for (uint64_t i = 0; i != header.nitems; ++i) {
+            if (i == reserved) {
+                const uint64_t n = std::min(header.nitems - reserved, std::max<uint64_t>(reserved, 1024));
+                reserve(static_cast<size_t>(n));
+                reserved += n;
+            }
+
+            cbk(reader);
+        }
+
+        reader.finish();
+    }
+}
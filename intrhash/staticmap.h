@@ -0,0 +1,208 @@
+#pragma once
+
+#include "hashers.h"
+
+#include <array>
+#include <stdexcept>
+#include <utility>
+
+// Hash and displace: keys fall into buckets of about two by their hash, and
+// each bucket gets the first seed that sends all of its keys to free slots.
+// Buckets are placed largest first, while most slots are still free, and the
+// slots are at most 80% used, so small seeds do.
+namespace intrhash_static_priv {
+    constexpr size_t max_seeds = size_t(1) << 16;
+
+    constexpr size_t pow2_at_least(size_t n) noexcept {
+        size_t result = 1;
+
+        while (result < n) {
+            result <<= 1;
+        }
+
+        return result;
+    }
+
+    template <size_t N>
+    struct shape_t {
+        static constexpr size_t nbuckets = pow2_at_least((N + 1) / 2);
+        static constexpr size_t nslots = pow2_at_least(N + N / 4);
+
+        using index_type = intrhash_util::select_type<(N <= 0xffff), uint16_t, uint32_t>;
+
+        static constexpr size_t bucket(size_t hash) noexcept {
+            return hash & (nbuckets - 1);
+        }
+
+        static constexpr size_t slot(size_t hash, size_t seed) noexcept {
+            return static_cast<size_t>(intrhash_hash_priv::mum(hash ^ (seed * 0x9e3779b97f4a7c15ull), intrhash_hash_priv::secret[2])) & (nslots - 1);
+        }
+    };
+}
+
+// A map over a key set fixed at compile time: make_intrhash_static_map()
+// finds a perfect hash in a constant expression, so a lookup is one hash, a
+// seed and a slot read and one key compare, with no heap and nothing to build
+// at startup. O is an intrhash ops type whose hash is usable at compile time
+// for K, as intrhash_fast_ops is for integers, enums and string views.
+template <class K, class T, size_t N, class O = intrhash_fast_ops>
+class intrhash_static_map_t {
+public:
+    using key_type = K;
+    using mapped_type = T;
+    using value_type = std::pair<K, T>;
+
+    using iterator = const value_type*;
+    using const_iterator = const value_type*;
+
+private:
+    static_assert(N != 0, "a static map takes at least one entry");
+
+    using shape_type = intrhash_static_priv::shape_t<N>;
+    using index_type = typename shape_type::index_type;
+
+public:
+    // throws std::invalid_argument, which fails the constant expression, on
+    // equal keys or keys whose hashes collide in full
+    constexpr explicit intrhash_static_map_t(const value_type (&entries)[N])
+        : intrhash_static_map_t(entries, std::make_index_sequence<N>())
+    {}
+
+private:
+    template <size_t... I>
+    constexpr intrhash_static_map_t(const value_type (&entries)[N], std::index_sequence<I...>)
+        : entries_{{entries[I]...}}
+    {
+        build_();
+    }
+
+    constexpr void build_() {
+        std::array<size_t, N> hashes{};
+        std::array<size_t, shape_type::nbuckets + 1> starts{};
+        std::array<index_type, N> members{};
+        std::array<bool, shape_type::nslots> used{};
+
+        for (size_t i = 0; i != N; ++i) {
+            hashes[i] = O::hash(entries_[i].first);
+            ++starts[shape_type::bucket(hashes[i]) + 1];
+        }
+
+        size_t largest = 0;
+
+        for (size_t b = 0; b != shape_type::nbuckets; ++b) {
+            largest = std::max(largest, starts[b + 1]);
+            starts[b + 1] += starts[b];
+        }
+
+        // members of bucket b are [starts[b], starts[b + 1])
+        {
+            std::array<size_t, shape_type::nbuckets> fill{};
+
+            for (size_t i = 0; i != N; ++i) {
+                const size_t b = shape_type::bucket(hashes[i]);
+                members[starts[b] + fill[b]++] = static_cast<index_type>(i);
+            }
+        }
+
+        for (size_t size = largest; size; --size) {
+            for (size_t b = 0; b != shape_type::nbuckets; ++b) {
+                if (starts[b + 1] - starts[b] == size) {
+                    place_(hashes, &members[starts[b]], size, used, b);
+                }
+            }
+        }
+    }
+
+    template <class H, class U>
+    constexpr void place_(const H& hashes, const index_type* members, size_t size, U& used, size_t bucket) {
+        for (size_t i = 0; i != size; ++i) {
+            for (size_t j = 0; j != i; ++j) {
+                if (O::equal_to(entries_[members[i]].first, entries_[members[j]].first)) {
+                    throw std::invalid_argument("intrhash_static_map_t: duplicate key");
+                }
+            }
+        }
+
+        std::array<size_t, N> slots{};
+
+        for (size_t seed = 0; seed != intrhash_static_priv::max_seeds; ++seed) {
+            bool fits = true;
+
+            for (size_t i = 0; fits && i != size; ++i) {
+                slots[i] = shape_type::slot(hashes[members[i]], seed);
+                fits = !used[slots[i]];
+
+                for (size_t j = 0; fits && j != i; ++j) {
+                    fits = slots[i] != slots[j];
+                }
+            }
+
+            if (fits) {
+                for (size_t i = 0; i != size; ++i) {
+                    used[slots[i]] = true;
+                    slots_[slots[i]] = members[i];
+                }
+
+                seeds_[bucket] = static_cast<uint16_t>(seed);
+                return;
+            }
+        }
+
+        throw std::invalid_argument("intrhash_static_map_t: keys with equal hashes");
+    }
+
+public:
+    constexpr const_iterator begin() const noexcept {
+        return entries_.data();
+    }
+
+    constexpr const_iterator end() const noexcept {
+        return entries_.data() + N;
+    }
+
+    // an unused slot names entry 0, which the key then fails to match, unless
+    // it is that key, whose own slot would have been read instead
+    template <class _K>
+    constexpr const value_type* find(const _K& key, size_t hash) const noexcept {
+        const value_type& entry = entries_[slots_[shape_type::slot(hash, seeds_[shape_type::bucket(hash)])]];
+        return O::equal_to(entry.first, key) ? &entry : nullptr;
+    }
+
+    template <class _K>
+    constexpr const value_type* find(const _K& key) const noexcept {
+        return find(key, O::hash(key));
+    }
+
+    template <class _K>
+    constexpr bool has(const _K& key) const noexcept {
+        return find(key);
+    }
+
+    template <class _K>
+    constexpr size_t count(const _K& key) const noexcept {
+        return has(key);
+    }
+
+    constexpr size_t size() const noexcept {
+        return N;
+    }
+
+    constexpr bool empty() const noexcept {
+        return !N;
+    }
+
+    constexpr size_t bucket_count() const noexcept {
+        return shape_type::nslots;
+    }
+
+private:
+    std::array<value_type, N> entries_;
+    std::array<index_type, shape_type::nslots> slots_{};
+    std::array<uint16_t, shape_type::nbuckets> seeds_{};
+};
+
+// make_intrhash_static_map<std::string_view, int>({{"get", 1}, {"set", 2}})
+template <class K, class T, class O = intrhash_fast_ops, size_t N>
+constexpr intrhash_static_map_t<K, T, N, O> make_intrhash_static_map(const std::pair<K, T> (&entries)[N]) {
+    return intrhash_static_map_t<K, T, N, O>(entries);
+}